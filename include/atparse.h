@@ -0,0 +1,9 @@
+#ifndef ATPARSE_H
+#define ATPARSE_H
+
+// parsers for modem response lines, kept free of the hardware so that they
+// can be tested on the host, see tests/
+
+bool atparse_shreq(const char*, const char*, uint32_t*, uint32_t*);
+
+#endif
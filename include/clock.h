@@ -0,0 +1,15 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+typedef enum {
+    CLOCK_IDLE,     // 4.2 MHz MSI, only waiting on timers
+    CLOCK_RUN,      // 16 MHz HSI, the default
+    CLOCK_BURST,    // 32 MHz HSI PLL, for payload encoding and UART bursts
+    CLOCK_N_MODES
+} clock_mode_t;
+
+void clock_setup(void);
+clock_mode_t clock_set_mode(clock_mode_t);
+clock_mode_t clock_get_mode(void);
+
+#endif
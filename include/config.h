@@ -0,0 +1,62 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// settings that can be changed at runtime, from the console or downlinked
+// from the server (see config_apply_json()), and persisted in EEPROM
+
+#define CONFIG_SAMPLE_INTERVAL_MS 6000
+#define CONFIG_UPLOAD_INTERVAL_MS 6000
+#define CONFIG_BATCH_SIZE 1
+#define CONFIG_REPORT_THRESHOLD 0       // C, 0 to disable
+#define CONFIG_FETCH_INTERVAL_MS 3600000
+#define CONFIG_APN "soracom.io"
+#define CONFIG_APN_USER "sora"
+#define CONFIG_APN_PWD "sora"
+#define CONFIG_HOST "demo.thingsboard.io"
+#define CONFIG_TOKEN "K11HoE3QMPE7rSHPf3Hj"
+#define CONFIG_TLS CONFIG_TLS_OFF
+#define CONFIG_UPLOAD_MIN_RSSI 10       // CSQ, about -93 dBm
+#define CONFIG_UPLOAD_MAX_BER 4
+#define CONFIG_UPLOAD_MAX_DELAY_MS 900000
+#define CONFIG_HEALTH_INTERVAL_MS 3600000
+
+#define CONFIG_TLS_OFF 0        // plain HTTP
+#define CONFIG_TLS_PER_POST 1   // HTTPS, a new connection (handshake) per post
+#define CONFIG_TLS_KEEP_ALIVE 2 // HTTPS, the connection is kept between posts
+
+#define CONFIG_URL_SIZE 288
+
+struct config {
+    uint32_t sample_interval_ms;
+    uint32_t upload_interval_ms;    // upload at least this often,
+    uint32_t batch_size;            // or once this many samples are queued,
+    float report_threshold;         // or the temperature moves this far (C)
+    uint32_t fetch_interval_ms;     // how often to check for new settings
+    uint32_t tls;                   // CONFIG_TLS_*
+    char apn[24];
+    char apn_user[8];
+    char apn_pwd[8];
+    char host[32];
+    char token[24];
+
+    // NVM_SLOT_CONFIG is full, from here on goes in NVM_SLOT_CONFIG_EXT
+
+    uint32_t upload_min_rssi;       // uploads that can wait, wait for this signal (0 not to),
+    uint32_t upload_max_ber;        // and at most this bit error rate,
+    uint32_t upload_max_delay_ms;   // but only for so long
+    uint32_t health_interval_ms;    // how often to post RAM use, with an upload
+};
+
+#define CONFIG_EXT_OFFSET offsetof(struct config, upload_min_rssi)
+
+void config_load(void);
+bool config_save(void);
+struct config *config_get(void);
+bool config_apply_json(const char*);
+bool config_key_is_string(const char*);
+void config_telemetry_path(char*, size_t);
+void config_attributes_path(char*, size_t);
+void config_telemetry_url(char*, size_t);
+void config_attributes_url(char*, size_t);
+
+#endif
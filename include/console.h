@@ -0,0 +1,10 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#define CONSOLE_LINE_SIZE 48
+#define CONSOLE_MAX_ARGS 4
+
+bool console_poll(void);
+bool console_upload_requested(void);
+
+#endif
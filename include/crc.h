@@ -0,0 +1,6 @@
+#ifndef CRC_H
+#define CRC_H
+
+uint32_t crc32(const void*, size_t);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef I2CBUS_H
+#define I2CBUS_H
+
+// I2C1 master on PB8 (SCL) and PB9 (SDA). A batch of transactions is run
+// back to back from the interrupts, see i2cbus_run()
+
+#define I2CBUS_TIMEOUT_MS 10    // per transaction
+#define I2CBUS_MAX_WRITE 2
+#define I2CBUS_MAX_READ 2
+
+typedef enum {
+    I2C_PENDING,
+    I2C_OK,
+    I2C_NACK,       // nobody at the address, or it refused a byte
+    I2C_BUS_ERROR,  // misplaced start/stop, lost arbitration
+    I2C_TIMEOUT,    // the bus was reset
+} i2c_status_t;
+
+struct i2c_xfer {
+    uint8_t addr;       // 7-bit
+    uint8_t wlen;       // bytes written, then
+    uint8_t rlen;       // bytes read after a repeated start; both 0 probes
+    uint8_t wbuf[I2CBUS_MAX_WRITE];
+    uint8_t rbuf[I2CBUS_MAX_READ];
+    volatile i2c_status_t status;
+    uint32_t cycles;    // how long it took, in CPU cycles
+};
+
+void i2cbus_setup(void);
+void i2cbus_clock_changed(void);
+bool i2cbus_run(struct i2c_xfer*, size_t);
+uint32_t i2cbus_cycles_to_us(uint32_t);
+
+#endif
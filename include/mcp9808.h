@@ -0,0 +1,13 @@
+#ifndef MCP9808_H
+#define MCP9808_H
+
+#define MCP9808_ADDR7 0x18      // to 0x1f with the address pins
+#define MCP9808_REG_TEMP 0x05
+#define MCP9808_REG_MANUFACTURER 0x06
+#define MCP9808_REG_DEVICE 0x07
+#define MCP9808_MANUFACTURER_ID 0x0054
+#define MCP9808_DEVICE_ID 0x04  // the upper byte, the lower is the revision
+
+extern const struct sensor_driver mcp9808_driver;
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef MEM_H
+#define MEM_H
+
+#define MEM_PAINT 0xa5a5a5a5    // unused stack is filled with this
+#define MEM_STACK_RESERVE 512   // bytes that _sbrk() won't hand to the heap
+
+struct mem_usage {
+    uint32_t data;          // .data, from the linker symbols
+    uint32_t bss;           // .bss
+    uint32_t heap;          // currently handed out by _sbrk()
+    uint32_t heap_max;
+    uint32_t stack_max;     // deepest the stack has been (painting)
+    uint32_t stack_size;    // from the heap's peak to the top of RAM
+    uint32_t free;          // never touched by either, the headroom left
+};
+
+void mem_setup(void);
+void mem_get_usage(struct mem_usage*);
+void mem_update_metrics(void);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+// counters and gauges shared across modules, dumped with metrics_print()
+
+typedef enum {
+    METRIC_BOOT_TO_READY_MS,
+    METRIC_BOOT_TO_REGISTERED_MS,
+    METRIC_BOOT_TO_FIRST_UPLOAD_MS,
+    METRIC_MODEM_BAUDRATE,
+    METRIC_MODEM_BAUD_FALLBACKS,
+    METRIC_MODEM_RX_BYTES,
+    METRIC_MODEM_RX_BYTES_PER_S,
+    METRIC_MODEM_LINE_ERRORS,
+    METRIC_CLOCK_4MHZ_MS,
+    METRIC_CLOCK_16MHZ_MS,
+    METRIC_CLOCK_32MHZ_MS,
+    METRIC_MEM_STATIC_BYTES,
+    METRIC_MEM_HEAP_BYTES,
+    METRIC_MEM_HEAP_MAX_BYTES,
+    METRIC_MEM_STACK_MAX_BYTES,
+    METRIC_MEM_FREE_BYTES,
+    METRIC_MODEM_AT_COMMANDS,
+    METRIC_MODEM_AT_TIMEOUTS,
+    METRIC_MODEM_AT_LATENCY_TOTAL_MS,
+    METRIC_MODEM_AT_LATENCY_MAX_MS,
+    METRIC_SERIAL_RX_MAX_DEPTH,
+    METRIC_SERIAL_RX_OVERFLOWS,
+    METRIC_RESET_CAUSE,
+    METRIC_RESETS_WATCHDOG,
+    METRIC_RECOVERY_MS,
+    METRIC_TIME_SYNCS,
+    METRIC_TIME_CORRECTION_MS,
+    METRIC_TLS_HANDSHAKES,
+    METRIC_UPLOADS,
+    METRIC_UPLOAD_LATENCY_TOTAL_MS,
+    METRIC_UPLOAD_LATENCY_MAX_MS,
+    METRIC_SENSORS,
+    METRIC_SENSOR_ERRORS,
+    METRIC_SENSOR_READ_US,
+    METRIC_UPLOADS_DEFERRED,
+    METRIC_COUNT
+} metric_t;
+
+void metrics_set(metric_t, uint32_t);
+void metrics_add(metric_t, uint32_t);
+uint32_t metrics_get(metric_t);
+void metrics_print(void);
+
+#endif
@@ -2,6 +2,7 @@
 #define MILLIS_H
 
 void millis_setup(void);
+void millis_clock_changed(void);
 uint64_t millis(void);
 void millis_delay(uint64_t);
 
@@ -3,12 +3,47 @@
 
 #define MODEM_CTO_MS 100 // character timeout in ms
 #define MODEM_BUF_SIZE 512
+#define MODEM_DEFAULT_BAUD 115200
+#define MODEM_BURST_GAP_MS 2    // inter-byte gap that ends a burst (throughput)
+#define MODEM_AT_LEN 320         // longest AT command we build (URLs)
+#define MODEM_QUERY_LEN 64       // longest line modem_query() will build
+#define MODEM_WARM_PROBE_MS 300  // is the modem still up from before?
+#define MODEM_LINK_CHECKS 20    // round trips to verify a new baud rate
+
+// preferred mode (AT+CNMP): 2 automatic, 13 GSM only, 38 LTE only,
+// 51 GSM and LTE only
+#define MODEM_PREFERRED_MODE 38
+// preferred selection between cat-m and nb-iot (AT+CMNB): 1 cat-M,
+// 2 NB-IOT, 3 cat-M and NB-IOT
+#define MODEM_PREFERRED_CAT 1
+
+struct modem_identity {
+    char imei[16];
+    char imsi[16];
+    char firmware[25];
+    uint8_t mode;   // AT+CNMP
+    uint8_t cat;    // AT+CMNB
+    uint8_t clts;   // AT+CLTS, network time updates
+};
+
+struct modem_vitals {
+    uint8_t functionality;  // AT+CFUN?, see modem_get_functionality()
+    uint8_t rssi;           // AT+CSQ, see modem_get_rssi_ber()
+    uint8_t ber;
+    uint8_t registration;   // AT+CGREG?
+    uint8_t system_mode;    // AT+CNSMOD?, see modem_get_network_system_mode()
+};
 
 bool modem_TEST(void);
 
 void modem_setup(void);
 bool modem_init(void);
+bool modem_refresh_identity(void);
 bool modem_wait_until_ready(uint64_t);
+bool modem_negotiate_baudrate(void);
+uint32_t modem_get_baudrate(void);
+void modem_update_metrics(void);
+void modem_clock_changed(void);
 
 void modem_power_up(void);
 void modem_power_down(void);
@@ -22,16 +57,34 @@ bool modem_get_imsi(void);
 bool modem_get_imei(void);
 bool modem_get_firmware_version(void);
 char *modem_imei_str(void);
+char *modem_imsi_str(void);
+char *modem_firmware_str(void);
+
+bool modem_query(const char**, size_t);
+const char *modem_query_find(const char*);
+bool modem_get_vitals(struct modem_vitals*);
 
 uint8_t *modem_get_buffer_data(void);
 char *modem_get_buffer_string(void);
 
-bool modem_connect_bearer(void);
-bool modem_post_temperature(float);
+bool modem_connect_bearer(const char*, const char*, const char*);
+bool modem_http_post(const char*, const char*);
+bool modem_http_get(const char*);
 bool modem_query_bearer(void);
 
+bool modem_connect_app_network(const char*);
+bool modem_https_connect(const char*, const char*);
+void modem_https_disconnect(void);
+bool modem_https_connected(void);
+bool modem_https_post(const char*, const char*);
+bool modem_https_get(const char*);
+bool modem_tls_load_ca(const char*, const char*);
+
 bool modem_get_rssi_ber(uint8_t*, uint8_t*);
 
+bool modem_get_network_time(uint64_t*);
+bool modem_ntp_sync(const char*);
+
 bool modem_gps_enable(void);
 bool modem_gps_get_nav(void);
 
@@ -0,0 +1,15 @@
+#ifndef NVM_H
+#define NVM_H
+
+// fixed-size records in the data EEPROM, each guarded by a length and crc
+
+#define NVM_SLOT_SIZE 128   // bytes, including the 8 byte header
+
+#define NVM_SLOT_MODEM 0
+#define NVM_SLOT_CONFIG 1
+#define NVM_SLOT_CONFIG_EXT 2    // the settings that didn't fit in NVM_SLOT_CONFIG
+
+bool nvm_load(uint8_t, void*, size_t);
+bool nvm_store(uint8_t, const void*, size_t);
+
+#endif
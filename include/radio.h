@@ -0,0 +1,35 @@
+#ifndef RADIO_H
+#define RADIO_H
+
+// signal quality history, and what uploads cost at each signal level
+
+#define RADIO_HISTORY 8     // vitals polls kept
+#define RADIO_STABLE 2      // polls in a row that must meet a threshold
+#define RADIO_ACTIVE_MW 400 // modem draw while posting, for the energy estimate
+
+#define RADIO_UNKNOWN 99    // AT+CSQ's value for either when it can't tell
+
+typedef enum {
+    RADIO_MARGINAL,     // CSQ 0-9, or unknown
+    RADIO_OK,           // 10-14
+    RADIO_GOOD,         // 15-19
+    RADIO_EXCELLENT,    // 20-31
+    RADIO_N_BUCKETS
+} radio_bucket_t;
+
+// the last RADIO_HISTORY readings
+struct radio_history {
+    uint8_t rssi[RADIO_HISTORY];
+    uint8_t ber[RADIO_HISTORY];
+    size_t head;    // the next to be written
+    size_t count;
+};
+
+void radio_setup(struct radio_history*);
+void radio_record(uint8_t, uint8_t);
+bool radio_link_good(uint32_t, uint32_t);
+radio_bucket_t radio_bucket(void);
+void radio_account(uint32_t, uint32_t, bool);
+void radio_print(void);
+
+#endif
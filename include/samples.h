@@ -0,0 +1,32 @@
+#ifndef SAMPLES_H
+#define SAMPLES_H
+
+// queue of samples waiting to be uploaded, oldest first
+
+#define SAMPLES_MAX 28          // queue capacity, the oldest are dropped
+#define SAMPLES_CHANNELS 4      // readings per sample, e.g. one per sensor
+#define SAMPLES_MAX_BATCH 16    // most samples in one upload
+#define SAMPLES_PAYLOAD_SIZE 512
+
+struct sample {
+    uint64_t ts;    // when it was captured, see samples_set_clock()
+    float values[SAMPLES_CHANNELS]; // NAN if that channel couldn't be read
+    uint32_t channels;
+};
+
+struct samples_queue {
+    struct sample buf[SAMPLES_MAX];
+    uint32_t head;  // oldest
+    uint32_t count;
+};
+
+void samples_setup(struct samples_queue*);
+void samples_set_keys(const char *const*);
+void samples_set_clock(uint64_t (*)(uint64_t));
+void samples_push(const struct sample*);
+size_t samples_count(void);
+const struct sample *samples_peek(size_t);
+void samples_drop(size_t);
+size_t samples_format_json(char*, size_t, size_t);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef SENSORS_H
+#define SENSORS_H
+
+// the sensors found on the I2C bus, read together once per sample
+
+#define SENSORS_MAX SAMPLES_CHANNELS
+#define SENSORS_NAME_SIZE 16
+#define SENSORS_SCAN_FIRST 0x08     // the rest are reserved addresses
+#define SENSORS_SCAN_LAST 0x77
+
+// a sensor type; every sample reads the 2 byte register reg
+struct sensor_driver {
+    const char *name;       // e.g. "MCP9808"
+    const char *quantity;   // e.g. "temperature", the JSON key
+    uint8_t addr_first;     // the addresses it can be strapped to
+    uint8_t addr_last;
+    uint8_t reg;
+    bool (*identify)(uint8_t);      // is it really one of these
+    float (*convert)(const uint8_t*);
+};
+
+struct sensor {
+    const struct sensor_driver *driver;
+    uint8_t addr;
+    char key[SENSORS_NAME_SIZE];    // e.g. "temperature_1"
+    float value;                    // NAN if the last read failed
+    uint32_t reads;
+    uint32_t errors;                // the timeouts included
+    uint32_t timeouts;
+    uint32_t latency_us;            // of the last read
+    uint32_t latency_max_us;
+};
+
+size_t sensors_scan(void);
+size_t sensors_count(void);
+const struct sensor *sensors_get(size_t);
+const char *const *sensors_keys(void);
+size_t sensors_read(float*);
+
+#endif
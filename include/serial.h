@@ -1,6 +1,13 @@
 #ifndef SERIAL_H
 #define SERIAL_H
 
+#define SERIAL_BAUD 115200
+#define SERIAL_RX_BUF_SIZE 64
+
 void serial_setup(void);
+bool serial_getc(char*);
+size_t serial_rx_depth(void);
+void serial_flush(void);
+void serial_clock_changed(void);
 
 #endif
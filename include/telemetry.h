@@ -0,0 +1,12 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+// posting samples and fetching settings, over HTTP or HTTPS as config->tls
+// says; when to do it is up to uplink.c
+
+bool telemetry_connect(void);
+size_t telemetry_post(void);
+bool telemetry_post_health(void);
+bool telemetry_fetch_config(void);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+// UTC from the network, as a mapping from the local clock (warm_clock())
+// that samples are stamped with. The mapping is corrected for the local
+// clock's measured drift, and errors found at a sync are slewed out rather
+// than stepped, so stamps taken before and after a sync stay in order
+
+#define TIMESYNC_INTERVAL_MS 3600000
+#define TIMESYNC_DRIFT_WINDOW_MS 3600000    // CCLK has 1 s resolution
+#define TIMESYNC_MAX_DRIFT_PPM 50000        // anything more is bogus
+#define TIMESYNC_SLEW_PPM 5000              // how fast an error is worked off
+#define TIMESYNC_STEP_MS 60000              // and past this, stepped instead
+#define TIMESYNC_NTP_SERVER "pool.ntp.org"
+
+struct timesync {
+    bool synced;
+    uint64_t utc;           // the mapping: UTC at
+    uint64_t local;         // this local time,
+    int32_t drift_ppm;      // how much faster UTC runs than the local clock,
+    int32_t slew_ms;        // and the error still being worked in after it
+    uint64_t window_utc;    // network time at the start of the drift
+    uint64_t window_local;  // measurement (0 if none), and local time then
+};
+
+void timesync_setup(struct timesync*, bool);
+bool timesync_sync(void);
+bool timesync_valid(void);
+uint64_t timesync_utc(uint64_t);
+uint64_t timesync_now_ms(void);
+int32_t timesync_drift_ppm(void);
+int32_t timesync_slew_ms(void);
+
+#endif
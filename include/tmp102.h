@@ -0,0 +1,10 @@
+#ifndef TMP102_H
+#define TMP102_H
+
+#define TMP102_ADDR7 0x48       // to 0x4b with the ADD0 pin
+#define TMP102_REG_TEMP 0x00
+#define TMP102_REG_CONFIG 0x01
+
+extern const struct sensor_driver tmp102_driver;
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef UPLINK_H
+#define UPLINK_H
+
+// When to upload, and what a post that went through (or didn't) changes.
+// Nothing here touches the hardware, so that tools/loadgen runs the same
+// schedule as the firmware; the caller does the connecting and posting.
+
+struct uplink {
+    bool due;               // an upload is wanted,
+    bool urgent;            // and doesn't wait for a good signal
+    bool deferred;          // it's waiting for one
+    bool connected;         // the data connection is up, a failed post drops it
+    bool draining;          // the last post went through, and more are queued
+    uint64_t due_since;     // when it fell due, 0 if it isn't
+    uint64_t next;          // when the next routine upload is due
+    float reference;        // the report threshold's, NAN until the first reading
+};
+
+void uplink_setup(struct uplink*, bool);
+void uplink_request(struct uplink*);
+void uplink_sampled(struct uplink*, const struct config*, const struct sample*);
+bool uplink_ready(struct uplink*, const struct config*, uint64_t, bool);
+void uplink_posted(struct uplink*, const struct config*, uint64_t, size_t);
+uint64_t uplink_wake(struct uplink*, uint64_t);
+
+#endif
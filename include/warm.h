@@ -0,0 +1,26 @@
+#ifndef WARM_H
+#define WARM_H
+
+// State that survives a warm restart (anything but a power on reset), kept
+// in the top WARM_SIZE bytes of RAM, which are excluded from the stack and
+// never initialised; see the Makefile
+
+#define WARM_SIZE 1024
+#define WARM_MAGIC 0x3a7d0004   // change when struct warm changes
+
+struct warm {
+    uint32_t magic;
+    uint32_t crc;   // of everything after it
+    uint32_t resets[RESET_N_CAUSES];
+    uint64_t clock_ms;  // warm_clock() at the last commit
+    bool ip_connected;
+    struct samples_queue samples;   // stamped with warm_clock()
+    struct timesync time;           // which maps to UTC
+};
+
+bool warm_setup(reset_cause_t);
+struct warm *warm_get(void);
+void warm_commit(void);
+uint64_t warm_clock(void);
+
+#endif
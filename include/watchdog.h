@@ -0,0 +1,34 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#define WATCHDOG_PERIOD_MS 20000        // IWDG timeout, ~28 s at most
+#define WATCHDOG_MAIN_DEADLINE_MS 120000
+#define WATCHDOG_MODEM_GRACE_MS 600000  // past upload_max_delay, to get one through
+
+// Each task checks in when it makes progress. watchdog_service() only
+// refreshes the IWDG while every task has checked in within its deadline,
+// so a task that is stuck, or a loop that never calls watchdog_service(),
+// ends in a reset.
+typedef enum {
+    WATCHDOG_TASK_MAIN,     // main loop iterations and idle waits
+    WATCHDOG_TASK_MODEM,    // the bearer coming up, and uploads going through
+    WATCHDOG_N_TASKS
+} watchdog_task_t;
+
+typedef enum {
+    RESET_POWER_ON,     // or brown out, nothing survives these
+    RESET_PIN,
+    RESET_SOFTWARE,
+    RESET_WATCHDOG,
+    RESET_LOW_POWER,
+    RESET_N_CAUSES
+} reset_cause_t;
+
+void watchdog_setup(void);
+void watchdog_set_deadline(watchdog_task_t, uint32_t);
+void watchdog_checkin(watchdog_task_t);
+void watchdog_service(void);
+reset_cause_t watchdog_reset_cause(void);
+const char *watchdog_reset_cause_str(reset_cause_t);
+
+#endif
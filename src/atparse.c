@@ -0,0 +1,33 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "atparse.h"
+
+bool atparse_shreq(const char *line, const char *method, uint32_t *status, uint32_t *len) {
+
+    // +SHREQ: "<method>",<status>,<len>
+    // Returns false if line isn't the response to a method request
+
+    static const char prefix[] = "+SHREQ: \"";
+    const char *p = line;
+    char *end;
+
+    if (strncmp(p, prefix, strlen(prefix))) return false;
+    p += strlen(prefix);
+    if (strncmp(p, method, strlen(method))) return false;
+    p += strlen(method);
+    if (strncmp(p, "\",", 2)) return false;
+    p += 2;
+
+    *status = strtoul(p, &end, 10);
+    if ((end == p) || (*end != ',')) return false;
+    p = end + 1;
+
+    *len = strtoul(p, &end, 10);
+    if (end == p) return false;
+
+    return true;
+
+}
@@ -0,0 +1,82 @@
+#include <libopencm3/stm32/rcc.h>
+
+#include "clock.h"
+#include "millis.h"
+#include "serial.h"
+#include "modem.h"
+#include "i2cbus.h"
+#include "metrics.h"
+
+static clock_mode_t _mode;
+static uint64_t _since;     // when we entered _mode, in ms
+
+static const metric_t _residency[CLOCK_N_MODES] = {
+    [CLOCK_IDLE] = METRIC_CLOCK_4MHZ_MS,
+    [CLOCK_RUN] = METRIC_CLOCK_16MHZ_MS,
+    [CLOCK_BURST] = METRIC_CLOCK_32MHZ_MS,
+};
+
+void clock_setup(void) {
+
+    // runs before the peripherals are set up, so there's nobody to tell
+
+    rcc_clock_setup_hsi(&rcc_clock_config[RCC_CLOCK_VRANGE1_HSI_RAW_16MHZ]);
+    _mode = CLOCK_RUN;
+    _since = 0;
+
+}
+
+clock_mode_t clock_set_mode(clock_mode_t mode) {
+
+    // returns the previous mode, so callers can put it back when done
+    //
+    // the libopencm3 setup functions switch SYSCLK over before lowering the
+    // flash wait states and after raising them, so any order of transitions
+    // is safe, as long as we never reconfigure the PLL while running from it
+
+    clock_mode_t prev = _mode;
+    uint64_t now;
+
+    if (mode == _mode) return prev;
+
+    serial_flush(); // don't garble the debug output mid-byte
+
+    switch (mode) {
+        case CLOCK_IDLE:
+            rcc_clock_setup_msi(&rcc_clock_config[RCC_CLOCK_VRANGE1_MSI_RAW_4MHZ]);
+            rcc_osc_off(RCC_PLL);
+            rcc_osc_off(RCC_HSI);
+            break;
+        case CLOCK_RUN:
+            rcc_clock_setup_hsi(&rcc_clock_config[RCC_CLOCK_VRANGE1_HSI_RAW_16MHZ]);
+            rcc_osc_off(RCC_PLL);
+            rcc_osc_off(RCC_MSI);
+            break;
+        case CLOCK_BURST:
+            rcc_clock_setup_pll(&rcc_clock_config[RCC_CLOCK_VRANGE1_HSI_PLL_32MHZ]);
+            rcc_osc_off(RCC_MSI);
+            break;
+        default:
+            return prev;
+    }
+
+    // everything derived from the bus clocks
+    millis_clock_changed();
+    serial_clock_changed();
+    modem_clock_changed();
+    i2cbus_clock_changed();
+
+    now = millis();
+    metrics_add(_residency[_mode], now - _since);
+    _since = now;
+    _mode = mode;
+
+    return prev;
+
+}
+
+clock_mode_t clock_get_mode(void) {
+
+    return _mode;
+
+}
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "config.h"
+#include "nvm.h"
+#include "samples.h"
+
+static const struct config _defaults = {
+    .sample_interval_ms = CONFIG_SAMPLE_INTERVAL_MS,
+    .upload_interval_ms = CONFIG_UPLOAD_INTERVAL_MS,
+    .batch_size = CONFIG_BATCH_SIZE,
+    .report_threshold = CONFIG_REPORT_THRESHOLD,
+    .fetch_interval_ms = CONFIG_FETCH_INTERVAL_MS,
+    .apn = CONFIG_APN,
+    .apn_user = CONFIG_APN_USER,
+    .apn_pwd = CONFIG_APN_PWD,
+    .host = CONFIG_HOST,
+    .token = CONFIG_TOKEN,
+    .tls = CONFIG_TLS,
+    .upload_min_rssi = CONFIG_UPLOAD_MIN_RSSI,
+    .upload_max_ber = CONFIG_UPLOAD_MAX_BER,
+    .upload_max_delay_ms = CONFIG_UPLOAD_MAX_DELAY_MS,
+    .health_interval_ms = CONFIG_HEALTH_INTERVAL_MS,
+};
+
+static struct config _config;
+
+// the settings that are JSON strings, the rest are numbers
+static const char *const _string_keys[] = {
+    "apn", "apn_user", "apn_pwd", "host", "token",
+};
+
+static const char *_json_find(const char*, const char*);
+static bool _json_uint(const char*, const char*, uint32_t*, uint32_t, uint32_t);
+static bool _json_str(const char*, const char*, char*, size_t);
+
+void config_load(void) {
+
+    // the defaults, unless something valid was saved; the two records are
+    // independent, so settings saved before the second one existed survive
+
+    uint8_t *p = (uint8_t *) &_config;
+    const uint8_t *d = (const uint8_t *) &_defaults;
+
+    if (!nvm_load(NVM_SLOT_CONFIG, p, CONFIG_EXT_OFFSET)) {
+        memcpy(p, d, CONFIG_EXT_OFFSET);
+    }
+    if (!nvm_load(NVM_SLOT_CONFIG_EXT, p + CONFIG_EXT_OFFSET, sizeof(_config) - CONFIG_EXT_OFFSET)) {
+        memcpy(p + CONFIG_EXT_OFFSET, d + CONFIG_EXT_OFFSET, sizeof(_config) - CONFIG_EXT_OFFSET);
+    }
+
+}
+
+bool config_save(void) {
+
+    const uint8_t *p = (const uint8_t *) &_config;
+
+    return nvm_store(NVM_SLOT_CONFIG, p, CONFIG_EXT_OFFSET)
+           && nvm_store(NVM_SLOT_CONFIG_EXT, p + CONFIG_EXT_OFFSET, sizeof(_config) - CONFIG_EXT_OFFSET);
+
+}
+
+struct config *config_get(void) {
+
+    return &_config;
+
+}
+
+bool config_apply_json(const char *json) {
+
+    // Apply whichever settings appear in json, e.g. the ThingsBoard shared
+    // attributes response:
+    //   {"shared":{"sample_interval":60000,"batch_size":10}}
+    // Values that are out of range are ignored. Returns true if anything
+    // changed (and was saved).
+
+    struct config c = _config;
+    const char *p;
+
+    _json_uint(json, "sample_interval", &c.sample_interval_ms, 1000, 86400000);
+    _json_uint(json, "upload_interval", &c.upload_interval_ms, 1000, 86400000);
+    _json_uint(json, "batch_size", &c.batch_size, 1, SAMPLES_MAX_BATCH);
+    _json_uint(json, "fetch_interval", &c.fetch_interval_ms, 60000, 86400000);
+    _json_uint(json, "tls", &c.tls, CONFIG_TLS_OFF, CONFIG_TLS_KEEP_ALIVE);
+    _json_uint(json, "upload_min_rssi", &c.upload_min_rssi, 0, 31);
+    _json_uint(json, "upload_max_ber", &c.upload_max_ber, 0, 7);
+    _json_uint(json, "upload_max_delay", &c.upload_max_delay_ms, 0, 86400000);
+    _json_uint(json, "health_interval", &c.health_interval_ms, 60000, 86400000);
+    if ((p = _json_find(json, "report_threshold"))) {
+        float threshold = strtof(p, NULL);
+        if (threshold >= 0) c.report_threshold = threshold;
+    }
+    _json_str(json, "apn", c.apn, sizeof(c.apn));
+    _json_str(json, "apn_user", c.apn_user, sizeof(c.apn_user));
+    _json_str(json, "apn_pwd", c.apn_pwd, sizeof(c.apn_pwd));
+    _json_str(json, "host", c.host, sizeof(c.host));
+    _json_str(json, "token", c.token, sizeof(c.token));
+
+    if (!memcmp(&c, &_config, sizeof(c))) return false;
+
+    _config = c;
+    config_save();
+
+    return true;
+
+}
+
+bool config_key_is_string(const char *key) {
+
+    for (size_t i=0; i<(sizeof(_string_keys) / sizeof(_string_keys[0])); i++) {
+        if (!strcmp(key, _string_keys[i])) return true;
+    }
+
+    return false;
+
+}
+
+void config_telemetry_path(char *buf, size_t size) {
+
+    snprintf(buf, size, "/api/v1/%s/telemetry", _config.token);
+
+}
+
+void config_attributes_path(char *buf, size_t size) {
+
+    // every key config_apply_json() understands
+    snprintf(buf, size, "/api/v1/%s/attributes?sharedKeys="
+            "sample_interval,upload_interval,batch_size,report_threshold,"
+            "fetch_interval,tls,upload_min_rssi,upload_max_ber,upload_max_delay,"
+            "health_interval,apn,apn_user,apn_pwd,host,token",
+            _config.token);
+
+}
+
+void config_telemetry_url(char *buf, size_t size) {
+
+    size_t n = snprintf(buf, size, "http://%s", _config.host);
+
+    if (n < size) config_telemetry_path(buf + n, size - n);
+
+}
+
+void config_attributes_url(char *buf, size_t size) {
+
+    size_t n = snprintf(buf, size, "http://%s", _config.host);
+
+    if (n < size) config_attributes_path(buf + n, size - n);
+
+}
+
+static const char *_json_find(const char *json, const char *key) {
+
+    // not a JSON parser, just enough for a flat set of known keys: returns a
+    // pointer to the value following "key":, or NULL
+
+    size_t n = strlen(key);
+    const char *p = json;
+
+    while ((p = strstr(p, key))) {
+        if ((p > json) && (p[-1] == '"') && (p[n] == '"')) {
+            p += n + 1;
+            while (*p == ' ') p++;
+            if (*p++ != ':') return NULL;
+            while (*p == ' ') p++;
+            return p;
+        }
+        p += n;
+    }
+
+    return NULL;
+
+}
+
+static bool _json_uint(const char *json, const char *key, uint32_t *value,
+                       uint32_t min, uint32_t max) {
+
+    const char *p;
+    char *end;
+    unsigned long v;
+
+    if (!(p = _json_find(json, key))) return false;
+
+    v = strtoul(p, &end, 10);
+    if ((end == p) || (v < min) || (v > max)) return false;
+
+    *value = v;
+
+    return true;
+
+}
+
+static bool _json_str(const char *json, const char *key, char *value, size_t size) {
+
+    // no escapes, and it has to fit
+
+    const char *p, *end;
+
+    if (!(p = _json_find(json, key))) return false;
+    if (*p++ != '"') return false;
+    if (!(end = strchr(p, '"'))) return false;
+    if ((size_t) (end - p) >= size) return false;
+
+    memcpy(value, p, end - p);
+    value[end - p] = '\0';
+
+    return true;
+
+}
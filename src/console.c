@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "console.h"
+#include "serial.h"
+#include "metrics.h"
+#include "mem.h"
+#include "modem.h"
+#include "config.h"
+#include "samples.h"
+#include "timesync.h"
+#include "sensors.h"
+#include "radio.h"
+
+// line-oriented command console on the debug UART, e.g. "set sample 10000"
+
+static char _line[CONSOLE_LINE_SIZE];
+static size_t _len = 0;
+static bool _upload_requested = false;
+
+static void _run(char*);
+static void _cmd_help(int, char**);
+static void _cmd_metrics(int, char**);
+static void _cmd_at(int, char**);
+static void _cmd_mem(int, char**);
+static void _cmd_queues(int, char**);
+static void _cmd_config(int, char**);
+static void _cmd_set(int, char**);
+static void _cmd_upload(int, char**);
+static void _cmd_time(int, char**);
+static void _cmd_sensors(int, char**);
+static void _cmd_radio(int, char**);
+
+static const struct {
+    const char *name;
+    void (*fn)(int, char**);
+    const char *help;
+} _commands[] = {
+    {"help", _cmd_help, "list commands"},
+    {"metrics", _cmd_metrics, "dump all metrics"},
+    {"at", _cmd_at, "AT command latency"},
+    {"mem", _cmd_mem, "RAM usage"},
+    {"queues", _cmd_queues, "queue depths"},
+    {"config", _cmd_config, "show settings"},
+    {"set", _cmd_set, "set <key> <value>, saved"},
+    {"upload", _cmd_upload, "upload now"},
+    {"time", _cmd_time, "UTC and clock drift"},
+    {"sensors", _cmd_sensors, "I2C sensors and their error counts"},
+    {"radio", _cmd_radio, "signal history, upload cost by signal"},
+};
+#define N_COMMANDS (sizeof(_commands) / sizeof(_commands[0]))
+
+bool console_poll(void) {
+
+    // Never blocks. Consumes whatever has been received, running each line
+    // as it completes. Returns true if a command ran, so that the caller can
+    // re-evaluate anything the command might have changed.
+
+    char c;
+    bool ran = false;
+
+    while (serial_getc(&c)) {
+
+        if ((c == '\r') || (c == '\n')) {
+            if (_len) {
+                printf("\n");
+                _line[_len] = '\0';
+                _run(_line);
+                _len = 0;
+                ran = true;
+            }
+        } else if ((c == '\b') || (c == 0x7f)) {
+            if (_len) {
+                _len--;
+                printf("\b \b");
+            }
+        } else if (_len < (CONSOLE_LINE_SIZE - 1)) {
+            _line[_len++] = c;
+            putchar(c);     // echo
+        }
+
+    }
+
+    return ran;
+
+}
+
+bool console_upload_requested(void) {
+
+    // clears the request
+
+    bool requested = _upload_requested;
+
+    _upload_requested = false;
+
+    return requested;
+
+}
+
+static void _run(char *line) {
+
+    char *argv[CONSOLE_MAX_ARGS];
+    int argc = 0;
+    char *tok;
+
+    tok = strtok(line, " ");
+    while (tok && (argc < CONSOLE_MAX_ARGS)) {
+        argv[argc++] = tok;
+        tok = strtok(NULL, " ");
+    }
+    if (!argc) return;
+
+    for (size_t i=0; i<N_COMMANDS; i++) {
+        if (!strcmp(argv[0], _commands[i].name)) {
+            _commands[i].fn(argc, argv);
+            return;
+        }
+    }
+
+    printf("unknown command: %s (try help)\n", argv[0]);
+
+}
+
+static void _cmd_help(int argc, char **argv) {
+
+    (void) argc;
+    (void) argv;
+
+    for (size_t i=0; i<N_COMMANDS; i++) {
+        printf("%-8s %s\n", _commands[i].name, _commands[i].help);
+    }
+
+}
+
+static void _cmd_metrics(int argc, char **argv) {
+
+    (void) argc;
+    (void) argv;
+
+    modem_update_metrics();
+    metrics_print();
+
+}
+
+static void _cmd_at(int argc, char **argv) {
+
+    uint32_t n = metrics_get(METRIC_MODEM_AT_COMMANDS);
+
+    (void) argc;
+    (void) argv;
+
+    printf("commands: %lu, timeouts: %lu\n", (unsigned long) n,
+            (unsigned long) metrics_get(METRIC_MODEM_AT_TIMEOUTS));
+    printf("latency (ms): mean %lu, max %lu\n",
+            (unsigned long) (n ? metrics_get(METRIC_MODEM_AT_LATENCY_TOTAL_MS) / n : 0),
+            (unsigned long) metrics_get(METRIC_MODEM_AT_LATENCY_MAX_MS));
+
+}
+
+static void _cmd_mem(int argc, char **argv) {
+
+    struct mem_usage mem;
+
+    (void) argc;
+    (void) argv;
+
+    mem_update_metrics();
+    mem_get_usage(&mem);
+    printf("data %lu, bss %lu\n", (unsigned long) mem.data, (unsigned long) mem.bss);
+    printf("heap %lu (max %lu)\n", (unsigned long) mem.heap, (unsigned long) mem.heap_max);
+    printf("stack max %lu of %lu, %lu free\n", (unsigned long) mem.stack_max,
+            (unsigned long) mem.stack_size, (unsigned long) mem.free);
+
+}
+
+static void _cmd_queues(int argc, char **argv) {
+
+    (void) argc;
+    (void) argv;
+
+    printf("samples: %u of %d\n", (unsigned) samples_count(), SAMPLES_MAX);
+    printf("console rx: %lu of %d (max %lu, %lu overflows)\n",
+            (unsigned long) serial_rx_depth(), SERIAL_RX_BUF_SIZE - 1,
+            (unsigned long) metrics_get(METRIC_SERIAL_RX_MAX_DEPTH),
+            (unsigned long) metrics_get(METRIC_SERIAL_RX_OVERFLOWS));
+
+}
+
+static void _cmd_config(int argc, char **argv) {
+
+    struct config *config = config_get();
+
+    (void) argc;
+    (void) argv;
+
+    printf("sample_interval %lu ms\n", (unsigned long) config->sample_interval_ms);
+    printf("upload_interval %lu ms\n", (unsigned long) config->upload_interval_ms);
+    printf("batch_size %lu\n", (unsigned long) config->batch_size);
+    printf("report_threshold %.3f C\n", config->report_threshold);
+    printf("fetch_interval %lu ms\n", (unsigned long) config->fetch_interval_ms);
+    printf("tls %lu\n", (unsigned long) config->tls);
+    printf("upload_min_rssi %lu, upload_max_ber %lu, upload_max_delay %lu ms\n",
+            (unsigned long) config->upload_min_rssi, (unsigned long) config->upload_max_ber,
+            (unsigned long) config->upload_max_delay_ms);
+    printf("health_interval %lu ms\n", (unsigned long) config->health_interval_ms);
+    printf("apn %s (%s/%s)\n", config->apn, config->apn_user, config->apn_pwd);
+    printf("host %s\n", config->host);
+    printf("token %s\n", config->token);
+
+}
+
+static void _cmd_set(int argc, char **argv) {
+
+    // goes through the same path as a downlink, so it's validated and saved
+
+    char json[CONSOLE_LINE_SIZE + 8];
+
+    if (argc != 3) {
+        printf("usage: set <key> <value>, keys as in config\n");
+        return;
+    }
+
+    // quoted by what the setting is, so e.g. "set apn_pwd 0000" works
+    if (config_key_is_string(argv[1])) {
+        snprintf(json, sizeof(json), "{\"%s\":\"%s\"}", argv[1], argv[2]);
+    } else {
+        snprintf(json, sizeof(json), "{\"%s\":%s}", argv[1], argv[2]);
+    }
+
+    if (!config_apply_json(json)) {
+        printf("no change (unknown key or out of range?)\n");
+        return;
+    }
+
+    _cmd_config(0, NULL);
+
+}
+
+static void _cmd_upload(int argc, char **argv) {
+
+    (void) argc;
+    (void) argv;
+
+    _upload_requested = true;
+    printf("upload requested\n");
+
+}
+
+static void _cmd_time(int argc, char **argv) {
+
+    uint64_t now = timesync_now_ms();
+
+    (void) argc;
+    (void) argv;
+
+    if (!timesync_valid()) {
+        printf("not synced\n");
+        return;
+    }
+
+    printf("UTC %lu.%03u s, drift %ld ppm, %ld ms still to slew\n",
+            (unsigned long) (now / 1000), (unsigned) (now % 1000),
+            (long) timesync_drift_ppm(), (long) timesync_slew_ms());
+
+}
+
+static void _cmd_sensors(int argc, char **argv) {
+
+    const struct sensor *s;
+
+    (void) argc;
+    (void) argv;
+
+    for (size_t i=0; (s = sensors_get(i)); i++) {
+        printf("0x%02x %s %s %.3f: %lu reads, %lu errors (%lu timeouts), %lu us (max %lu)\n",
+                s->addr, s->driver->name, s->key, s->value, (unsigned long) s->reads,
+                (unsigned long) s->errors, (unsigned long) s->timeouts,
+                (unsigned long) s->latency_us, (unsigned long) s->latency_max_us);
+    }
+    printf("%lu sensors, last read %lu us\n", (unsigned long) sensors_count(),
+            (unsigned long) metrics_get(METRIC_SENSOR_READ_US));
+
+}
+
+static void _cmd_radio(int argc, char **argv) {
+
+    (void) argc;
+    (void) argv;
+
+    radio_print();
+    printf("%lu uploads deferred for the signal\n",
+            (unsigned long) metrics_get(METRIC_UPLOADS_DEFERRED));
+
+}
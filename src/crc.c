@@ -0,0 +1,23 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "crc.h"
+
+uint32_t crc32(const void *data, size_t len) {
+
+    // plain bitwise CRC-32 (IEEE 802.3), small rather than fast; it's only
+    // used on records of a few hundred bytes
+
+    const uint8_t *p = data;
+    uint32_t crc = 0xffffffff;
+
+    while (len--) {
+        crc ^= *p++;
+        for (int i=0; i<8; i++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+
+}
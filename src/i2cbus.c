@@ -0,0 +1,300 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/i2c.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/dwt.h>
+
+#include "i2cbus.h"
+#include "millis.h"
+
+extern void i2c1_ev_isr(void);
+extern void i2c1_er_isr(void);
+
+// where the transaction in flight is up to
+typedef enum {
+    PHASE_START,    // waiting to send the address for writing
+    PHASE_WRITE,
+    PHASE_RESTART,  // waiting to send the address for reading
+    PHASE_READ,
+} phase_t;
+
+// the batch being run; _cur only moves forward, and only in the interrupts
+// while they're enabled
+static struct i2c_xfer *_xfers;
+static volatile size_t _n = 0;
+static volatile size_t _cur = 0;
+static volatile phase_t _phase;
+static size_t _widx;
+static uint32_t _started;
+
+static void _configure(void);
+static void _recover(void);
+static void _begin(void);
+static void _finish(i2c_status_t);
+
+void i2cbus_setup(void) {
+
+    rcc_periph_clock_enable(RCC_GPIOB);
+    gpio_set_output_options(GPIOB, GPIO_OTYPE_OD, GPIO_OSPEED_10MHZ, GPIO8 | GPIO9);
+    gpio_set_af(GPIOB, GPIO_AF4, GPIO8 | GPIO9);
+    gpio_mode_setup(GPIOB, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO8 | GPIO9);
+
+    rcc_periph_clock_enable(RCC_I2C1);
+    _configure();
+
+    nvic_enable_irq(NVIC_I2C1_EV_IRQ);
+    nvic_enable_irq(NVIC_I2C1_ER_IRQ);
+
+    // for the per-transaction latency
+    dwt_enable_cycle_counter();
+
+}
+
+void i2cbus_clock_changed(void) {
+
+    // the timing registers can only be written with the peripheral disabled
+
+    i2c_peripheral_disable(I2C1);
+    i2c_set_speed(I2C1, i2c_speed_sm_100k, rcc_apb1_frequency / 1000000);
+    i2c_peripheral_enable(I2C1);
+
+}
+
+bool i2cbus_run(struct i2c_xfer *xfers, size_t n) {
+
+    // Runs the n transactions in order and waits for them all. One that
+    // fails doesn't stop the rest; one that hangs the bus for longer than
+    // I2CBUS_TIMEOUT_MS gets the bus reset, and the rest carry on after it.
+    // Returns true if they all succeeded.
+
+    uint64_t deadline;
+    size_t i, last;
+    bool ok = true;
+
+    if (!n) return true;
+
+    for (i=0; i<n; i++) xfers[i].status = I2C_PENDING;
+
+    _xfers = xfers;
+    _cur = 0;
+    _n = n;
+
+    _begin();
+    last = 0;
+    deadline = millis() + I2CBUS_TIMEOUT_MS;
+
+    while (_cur < _n) {
+
+        if (_cur != last) {
+            last = _cur;
+            deadline = millis() + I2CBUS_TIMEOUT_MS;
+            continue;
+        }
+        if (millis() < deadline) continue;
+
+        // stuck; the interrupts are kept out while it's cleared up, in
+        // case it finishes after all
+        cm_disable_interrupts();
+        if (_cur == last) {
+            i2c_disable_interrupt(I2C1, I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN);
+            _xfers[_cur].status = I2C_TIMEOUT;
+            _xfers[_cur].cycles = dwt_read_cycle_counter() - _started;
+            _recover();
+            if (++_cur < _n) _begin();
+        }
+        cm_enable_interrupts();
+
+    }
+
+    for (i=0; i<n; i++) {
+        if (xfers[i].status != I2C_OK) ok = false;
+    }
+
+    return ok;
+
+}
+
+uint32_t i2cbus_cycles_to_us(uint32_t cycles) {
+
+    return cycles / (rcc_ahb_frequency / 1000000);
+
+}
+
+static void _configure(void) {
+
+    rcc_periph_reset_pulse(RST_I2C1);
+    i2c_set_speed(I2C1, i2c_speed_sm_100k, rcc_apb1_frequency / 1000000);
+    i2c_peripheral_enable(I2C1);
+
+}
+
+static void _recover(void) {
+
+    // A slave that was cut off mid-byte can hold SDA low indefinitely, and
+    // the peripheral can't get out of that by itself. Clocking SCL until the
+    // slave lets go and then resetting the peripheral clears it.
+
+    int i;
+    volatile int j;
+
+    gpio_mode_setup(GPIOB, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, GPIO8);
+    for (i=0; (i < 9) && !gpio_get(GPIOB, GPIO9); i++) {
+        gpio_clear(GPIOB, GPIO8);
+        for (j=0; j<50; j++);
+        gpio_set(GPIOB, GPIO8);
+        for (j=0; j<50; j++);
+    }
+    gpio_mode_setup(GPIOB, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO8);
+
+    _configure();
+
+}
+
+static void _begin(void) {
+
+    // start the transaction at _cur
+
+    struct i2c_xfer *x = &_xfers[_cur];
+    uint32_t spins = 1000;
+
+    // a stop that's still going out has to finish before the next start
+    while ((I2C_CR1(I2C1) & I2C_CR1_STOP) && --spins);
+
+    _started = dwt_read_cycle_counter();
+    _widx = 0;
+    _phase = (x->wlen || !x->rlen) ? PHASE_START : PHASE_RESTART;
+
+    // two byte reads NACK the second byte, see the reference manual
+    if (x->rlen == 2) {
+        i2c_enable_ack(I2C1);
+        i2c_nack_next(I2C1);
+    }
+
+    i2c_enable_interrupt(I2C1, I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);
+    i2c_send_start(I2C1);
+
+}
+
+static void _finish(i2c_status_t status) {
+
+    // the transaction at _cur is done, on to the next one if there is
+
+    struct i2c_xfer *x = &_xfers[_cur];
+
+    x->cycles = dwt_read_cycle_counter() - _started;
+    x->status = status;
+
+    i2c_disable_interrupt(I2C1, I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN);
+    i2c_nack_current(I2C1);
+    i2c_disable_ack(I2C1);
+
+    if (++_cur < _n) _begin();
+
+}
+
+void i2c1_ev_isr(void) {
+
+    struct i2c_xfer *x;
+    uint32_t sr1;
+
+    if (_cur >= _n) {
+        i2c_disable_interrupt(I2C1, I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN);
+        return;
+    }
+
+    x = &_xfers[_cur];
+    sr1 = I2C_SR1(I2C1);
+
+    // the start (or repeated start) went out, now the address
+    if (sr1 & I2C_SR1_SB) {
+        if (_phase == PHASE_START) {
+            i2c_send_data(I2C1, x->addr << 1);
+            _phase = PHASE_WRITE;
+        } else {
+            i2c_send_data(I2C1, (x->addr << 1) | 1);
+            _phase = PHASE_READ;
+        }
+        return;
+    }
+
+    // the address was acknowledged
+    if (sr1 & I2C_SR1_ADDR) {
+
+        if (_phase == PHASE_WRITE) {
+            (void) I2C_SR2(I2C1);   // clears ADDR
+            if (x->wlen) {
+                i2c_send_data(I2C1, x->wbuf[_widx++]);
+            } else {
+                // just a probe
+                i2c_send_stop(I2C1);
+                _finish(I2C_OK);
+            }
+        } else if (x->rlen == 1) {
+            // the only byte is NACKed, and the stop set before it's in
+            i2c_disable_ack(I2C1);
+            (void) I2C_SR2(I2C1);
+            i2c_send_stop(I2C1);
+            i2c_enable_interrupt(I2C1, I2C_CR2_ITBUFEN);
+        } else {
+            // both bytes arrive before BTF
+            (void) I2C_SR2(I2C1);
+            i2c_disable_ack(I2C1);
+        }
+        return;
+
+    }
+
+    if (sr1 & I2C_SR1_BTF) {
+
+        if (_phase == PHASE_WRITE) {
+            if (_widx < x->wlen) {
+                i2c_send_data(I2C1, x->wbuf[_widx++]);
+            } else if (x->rlen) {
+                _phase = PHASE_RESTART;
+                i2c_send_start(I2C1);
+            } else {
+                i2c_send_stop(I2C1);
+                _finish(I2C_OK);
+            }
+        } else if ((_phase == PHASE_READ) && (x->rlen == 2)) {
+            i2c_send_stop(I2C1);
+            x->rbuf[0] = i2c_get_data(I2C1);
+            x->rbuf[1] = i2c_get_data(I2C1);
+            _finish(I2C_OK);
+        }
+        return;
+
+    }
+
+    if ((sr1 & I2C_SR1_RxNE) && (_phase == PHASE_READ) && (x->rlen == 1)) {
+        x->rbuf[0] = i2c_get_data(I2C1);
+        _finish(I2C_OK);
+    }
+
+}
+
+void i2c1_er_isr(void) {
+
+    uint32_t sr1 = I2C_SR1(I2C1);
+
+    I2C_SR1(I2C1) = sr1 & ~(I2C_SR1_AF | I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_OVR);
+
+    if (_cur >= _n) {
+        i2c_disable_interrupt(I2C1, I2C_CR2_ITERREN);
+        return;
+    }
+
+    if (sr1 & I2C_SR1_AF) {
+        // still the master, so the bus is released properly
+        i2c_send_stop(I2C1);
+        _finish(I2C_NACK);
+    } else if (sr1 & (I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_OVR)) {
+        _finish(I2C_BUS_ERROR);
+    }
+
+}
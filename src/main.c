@@ -2,20 +2,36 @@
 
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
+#include <libopencm3/cm3/cortex.h>
 
 #include "leds.h"
 #include "serial.h"
-#include "thermometer.h"
+#include "i2cbus.h"
+#include "sensors.h"
 #include "modem.h"
 #include "millis.h"
+#include "metrics.h"
+#include "clock.h"
+#include "mem.h"
+#include "config.h"
+#include "console.h"
+#include "samples.h"
+#include "watchdog.h"
+#include "timesync.h"
+#include "warm.h"
+#include "radio.h"
+#include "uplink.h"
+#include "telemetry.h"
 
 //
 
+static void _idle_until(uint64_t);
+
 ////
 
 static void main_setup(void) {
 
-    rcc_clock_setup_hsi(&rcc_clock_config[2]);  // 16mhz hsi raw
+    clock_setup();  // 16mhz hsi raw, see clock_set_mode()
 
     // some debug signals PA10 and PB3
     rcc_periph_clock_enable(RCC_GPIOA);
@@ -27,118 +43,275 @@ static void main_setup(void) {
 
 }
 
+static void _idle_until(uint64_t until) {
+
+    // sleep at the idle clock with the console still live; returns early if
+    // a console command ran, since it may have changed the schedule. The
+    // SysTick wakes us every ms, and the debug UART on every byte.
+
+    clock_mode_t prev;
+
+    prev = clock_set_mode(CLOCK_IDLE);
+
+    while (millis() < until) {
+        watchdog_checkin(WATCHDOG_TASK_MAIN);
+        watchdog_service();
+        if (console_poll()) break;
+        __WFI();
+    }
+
+    clock_set_mode(prev);
+
+}
+
 int main(void) {
 
+    mem_setup();
     main_setup();
     millis_setup();
     leds_setup();
     serial_setup();
-    thermometer_setup();
+    i2cbus_setup();
     modem_setup();
     setbuf(stdout, NULL);   // optional
 
     printf("\n[STATUS] sciota is risen\n\n");
 
+    // from here on, anything that hangs for long ends in a reset
+    watchdog_setup();
 
-    // bring up the modem
+    bool warm = warm_setup(watchdog_reset_cause());
+    samples_setup(&warm_get()->samples);
+    timesync_setup(&warm_get()->time, warm);
+    warm_commit();
+    samples_set_clock(timesync_utc);
+    metrics_set(METRIC_RESET_CAUSE, watchdog_reset_cause());
+    metrics_set(METRIC_RESETS_WATCHDOG, warm_get()->resets[RESET_WATCHDOG]);
+    printf("[STATUS] reset cause: %s, %s restart with %u samples queued\n",
+            watchdog_reset_cause_str(watchdog_reset_cause()),
+            warm ? "warm" : "cold", (unsigned) samples_count());
 
-    modem_reset();
-    while (!modem_wait_until_ready(10000)) {
-        printf("[ERROR] modem is unresponsive\n");
-    }
+    config_load();
 
-    while (!modem_init()) {
-        printf("[ERROR] modem_init failed\n");
+    if (!sensors_scan()) {
+        printf("[ERROR] no sensors found\n");
     }
+    samples_set_keys(sensors_keys());
+
+
+    // bring up the modem
 
-    while (!modem_get_imei()) {
-        printf("[ERROR] modem_get_imei failed\n");
+    // if the MCU was reset on its own, the modem may well still be up (and
+    // registered), in which case there's no need to reset it
+    if (!modem_wait_until_ready(MODEM_WARM_PROBE_MS)) {
+        modem_reset();
+        warm_get()->ip_connected = false;   // the bearer went with it
+        warm_commit();
+        while (!modem_wait_until_ready(10000)) {
+            printf("[ERROR] modem is unresponsive\n");
+        }
     }
-    printf("[STATUS] IMEI: %s\n", modem_get_buffer_string());
+    metrics_set(METRIC_BOOT_TO_READY_MS, millis());
 
-    while (!modem_get_imsi()) {
-        printf("[ERROR] modem_get_imsi failed\n");
+    while (!modem_init()) {
+        printf("[ERROR] modem_init failed\n");
     }
-    printf("[STATUS] IMSI: %s\n", modem_get_buffer_string());
+    printf("[STATUS] IMEI: %s\n", modem_imei_str());
 
-    while (!modem_get_firmware_version()) {
-        printf("[ERROR] modem_get_firmware_version failed\n");
+    if (!modem_negotiate_baudrate()) {
+        printf("[ERROR] modem_negotiate_baudrate failed\n");
     }
-    printf("firmware version = %s\n", modem_get_buffer_string());
+    printf("[STATUS] modem link: %lu baud\n", (unsigned long) modem_get_baudrate());
 
 
     // main loop
 
     printf("\n[STATUS] entering main loop\n");
 
-    float temp;
-    uint8_t fun, rssi, ber, reg, mode;  // modem vitals
+    struct config *config = config_get();
+    uint32_t tls = config->tls;
+    struct sample sample = {0};
+    struct modem_vitals vitals = {0};
+    struct mem_usage mem;
+    struct uplink uplink;
 
-    bool ip_connected = false;
+    bool have_identity = false;
+    uint64_t next_sample = 0;
+    uint64_t next_fetch = 0;
+    uint64_t next_timesync = 0;
+    uint64_t next_health = 0;
 
-    while (1) {
+    uplink_setup(&uplink, warm_get()->ip_connected);
 
-        printf("\n");
+    while (1) {
 
-        // blink the LED
-        leds_green_on();
-        millis_delay(500);
-        leds_green_off();
-        millis_delay(500);
+        watchdog_checkin(WATCHDOG_TASK_MAIN);
+        watchdog_service();
 
-        // get the time and temperature
-        printf("Time (s): %.3f\n", millis()/1000.);
-        temp = thermometer_read();
-        printf("Temp (C): %.3f\n", temp);
+        if (console_upload_requested()) uplink_request(&uplink);
 
-        // modem vitals
-        if (!modem_get_functionality(&fun)) {
-            printf("[ERROR] modem_get_functionality failed\n");
-        } else {
-            printf("Modem Functionality: %d\n", fun);
-        }
-        if (!modem_get_rssi_ber(&rssi, &ber)) {
-            printf("[ERROR] modem_get_rssi_ber failed\n");
-        } else {
-            printf("RSSI = %d, BER = %d\n", rssi, ber);
+        // HTTP and HTTPS don't run over the same connection
+        if (config->tls != tls) {
+            uplink.connected = false;
+            tls = config->tls;
         }
-        if (!modem_get_network_registration(&reg)) {
-            printf("[ERROR] modem_get_network_registration failed\n");
-        } else {
-            printf("Network Registration Status: %d\n", reg);
+
+        if (millis() >= next_sample) {
+
+            next_sample = millis() + config->sample_interval_ms;
+
+            printf("\n");
+            leds_green_on();
+
+            // get the time and every sensor's reading
+            printf("Time (s): %.3f\n", millis()/1000.);
+            sample.ts = warm_clock();
+            sample.channels = sensors_read(sample.values);
+            for (size_t i=0; i<sample.channels; i++) {
+                printf("%s: %.3f\n", sensors_get(i)->key, sample.values[i]);
+            }
+            samples_push(&sample);
+            warm_commit();
+            uplink_sampled(&uplink, config, &sample);
+
+            // modem vitals
+            if (!modem_get_vitals(&vitals)) {
+                printf("[ERROR] modem_get_vitals failed\n");
+            } else {
+                printf("Modem Functionality: %d\n", vitals.functionality);
+                printf("RSSI = %d, BER = %d\n", vitals.rssi, vitals.ber);
+                radio_record(vitals.rssi, vitals.ber);
+                printf("Network Registration Status: %d\n", vitals.registration);
+                printf("Network System Mode: %d\n", vitals.system_mode);
+            }
+            modem_update_metrics();
+            printf("Modem link: %lu B/s, %lu line errors\n",
+                    (unsigned long) metrics_get(METRIC_MODEM_RX_BYTES_PER_S),
+                    (unsigned long) metrics_get(METRIC_MODEM_LINE_ERRORS));
+
+            // memory
+            mem_update_metrics();
+            mem_get_usage(&mem);
+            printf("RAM: static %lu, heap %lu (max %lu), stack max %lu of %lu, %lu free\n",
+                    (unsigned long) (mem.data + mem.bss), (unsigned long) mem.heap,
+                    (unsigned long) mem.heap_max, (unsigned long) mem.stack_max,
+                    (unsigned long) mem.stack_size, (unsigned long) mem.free);
+
+            // the modem registers by itself, so the identity queries are done
+            // here in the meantime rather than holding up bring-up
+            if (!have_identity) {
+                if (!modem_refresh_identity()) {
+                    printf("[ERROR] modem_refresh_identity failed\n");
+                } else {
+                    printf("[STATUS] IMSI: %s\n", modem_imsi_str());
+                    printf("[STATUS] firmware version: %s\n", modem_firmware_str());
+                    have_identity = true;
+                }
+            }
+
+            if (((vitals.registration==1) || (vitals.registration==5)) && !metrics_get(METRIC_BOOT_TO_REGISTERED_MS)) {
+                metrics_set(METRIC_BOOT_TO_REGISTERED_MS, millis());
+                printf("[STATUS] registered after %lu ms\n",
+                        (unsigned long) metrics_get(METRIC_BOOT_TO_REGISTERED_MS));
+            }
+
+            // the network sets the modem's clock when it registers, no data
+            // connection needed; samples get their UTC time when they're
+            // sent, so the ones taken until then are covered too
+            if (((vitals.registration==1) || (vitals.registration==5)) && (millis() >= next_timesync)) {
+                if (!timesync_sync()) {
+                    printf("[ERROR] timesync_sync failed\n");
+                } else {
+                    next_timesync = millis() + TIMESYNC_INTERVAL_MS;
+                    warm_commit();
+                }
+            }
+
+            leds_green_off();
+
         }
-        if (!modem_get_network_system_mode(&mode)) {
-            printf("[ERROR] modem_get_network_system_mode failed\n");
-        } else {
-            printf("Network System Mode: %d\n", mode);
+
+        bool deferred = uplink.deferred;
+        bool send = uplink_ready(&uplink, config, millis(),
+                radio_link_good(config->upload_min_rssi, config->upload_max_ber));
+        if (uplink.deferred && !deferred) {
+            printf("[STATUS] upload deferred, RSSI %d, BER %d\n", vitals.rssi, vitals.ber);
         }
 
+        // Answering AT commands isn't progress, a modem stuck failing to
+        // connect still does that. Once an upload is due, the modem has
+        // upload_max_delay_ms (the longest it may be put off) and then some
+        // to get it through, or to at least bring the bearer up.
+        watchdog_set_deadline(WATCHDOG_TASK_MODEM,
+                uplink.due ? config->upload_max_delay_ms + WATCHDOG_MODEM_GRACE_MS : 0);
+
         // internets
-        if ((fun==1) && (reg==5) && (mode==7)) {
+        if ((send || (millis() >= next_fetch)) && (vitals.functionality==1) && (vitals.registration==5) && (vitals.system_mode==7)) {
+
+            clock_set_mode(CLOCK_BURST);
+
+            // a failed connection is retried with the next sample, not on
+            // the spot
+            if (!uplink.connected) {
+                if (!telemetry_connect()) {
+                    printf("[ERROR] telemetry_connect failed\n");
+                } else {
+                    printf("Data connection established\n");
+                    uplink.connected = true;
+                    watchdog_checkin(WATCHDOG_TASK_MODEM);
+                }
+            }
 
-            if (!ip_connected) {
-                while (!modem_connect_bearer()) {
-                    printf("[ERROR] modem_connect_bearer failed\n");
-                    millis_delay(1000);
+            if (uplink.connected && send) {
+                size_t n = telemetry_post();
+                uplink_posted(&uplink, config, millis(), n);
+                warm_commit();
+                if (!n) {
+                    printf("[ERROR] upload failed\n");
+                } else {
+                    watchdog_checkin(WATCHDOG_TASK_MODEM);
+                    if (!metrics_get(METRIC_BOOT_TO_FIRST_UPLOAD_MS)) {
+                        metrics_set(METRIC_BOOT_TO_FIRST_UPLOAD_MS, millis());
+                        printf("[STATUS] first upload after %lu ms\n",
+                                (unsigned long) metrics_get(METRIC_BOOT_TO_FIRST_UPLOAD_MS));
+                        if (watchdog_reset_cause() != RESET_POWER_ON) {
+                            metrics_set(METRIC_RECOVERY_MS, millis());
+                        }
+                    }
                 }
-                printf("Bearer connection established\n");
-                ip_connected = true;
             }
 
-            if (!modem_post_temperature(temp)) {
-                printf("[ERROR] modem_post_temperature failed\n");
-                ip_connected = false;
-            } else {
-                printf("HTTP POST succeeded\n");
+            // RAM use, along with an upload rather than waking the radio
+            // for it
+            if (uplink.connected && send && (millis() >= next_health)) {
+                if (!telemetry_post_health()) {
+                    printf("[ERROR] health post failed\n");
+                } else {
+                    next_health = millis() + config->health_interval_ms;
+                }
             }
 
+            // settings downlink
+            if (uplink.connected && (millis() >= next_fetch)) {
+                if (!telemetry_fetch_config()) {
+                    printf("[ERROR] config fetch failed\n");
+                    next_fetch = next_sample;
+                } else {
+                    next_fetch = millis() + config->fetch_interval_ms;
+                }
+            }
+
+            warm_get()->ip_connected = uplink.connected;
+            warm_commit();
+
+            clock_set_mode(CLOCK_RUN);
+
         }
 
-        millis_delay(5000);
+        _idle_until(uplink_wake(&uplink, next_sample));
 
     }
 
     return 0;
 
 }
-
@@ -0,0 +1,57 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "i2cbus.h"
+#include "samples.h"
+#include "sensors.h"
+#include "mcp9808.h"
+
+static bool _identify(uint8_t);
+static float _convert(const uint8_t*);
+
+const struct sensor_driver mcp9808_driver = {
+    .name = "MCP9808",
+    .quantity = "temperature",
+    .addr_first = MCP9808_ADDR7,
+    .addr_last = MCP9808_ADDR7 + 7,
+    .reg = MCP9808_REG_TEMP,
+    .identify = _identify,
+    .convert = _convert,
+};
+
+static bool _identify(uint8_t addr) {
+
+    struct i2c_xfer xfers[2] = {
+        {.addr = addr, .wlen = 1, .rlen = 2, .wbuf = {MCP9808_REG_MANUFACTURER}},
+        {.addr = addr, .wlen = 1, .rlen = 2, .wbuf = {MCP9808_REG_DEVICE}},
+    };
+
+    if (!i2cbus_run(xfers, 2)) return false;
+
+    return (((xfers[0].rbuf[0] << 8) | xfers[0].rbuf[1]) == MCP9808_MANUFACTURER_ID)
+           && (xfers[1].rbuf[0] == MCP9808_DEVICE_ID);
+
+}
+
+static float _convert(const uint8_t *raw) {
+
+    // see example 5-1 in the in the MCP9808 datasheet
+
+    uint8_t MSB, LSB;
+    float result;
+
+    MSB = raw[0];
+    LSB = raw[1];
+
+    MSB = MSB & 0x1f;   // clear flag bits
+    if (MSB & 0x10) {
+        MSB = MSB & 0x0f;   // clear sign bit
+        result = 256 - (MSB * 16 + LSB / 16.);
+    } else {
+        result = (MSB * 16 + LSB / 16.);
+    }
+
+    return result;
+
+}
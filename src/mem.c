@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+
+#include "mem.h"
+#include "metrics.h"
+
+// from the libopencm3 linker script
+extern uint32_t _data, _edata, _ebss, end, _stack;
+
+extern void *_sbrk(ptrdiff_t);
+
+static char *_brk = (char *) &end;  // heap runs from end to _brk
+static char *_brk_max = (char *) &end;
+
+static inline char *_get_sp(void) {
+
+    char *sp;
+
+    __asm__ volatile ("mov %0, sp" : "=r" (sp));
+
+    return sp;
+
+}
+
+void mem_setup(void) {
+
+    // Paint everything between the heap and (just below) the live stack, so
+    // that mem_get_usage() can find out how deep the stack has been.
+    // Call this as early as possible in main().
+
+    uint32_t *p = (uint32_t *) _brk;
+    uint32_t *sp = (uint32_t *) (_get_sp() - 64);   // leave our own frame alone
+
+    while (p < sp) {
+        *p++ = MEM_PAINT;
+    }
+
+}
+
+void mem_get_usage(struct mem_usage *usage) {
+
+    // the heap grows up into paint, and may have given some of it back, so
+    // scanning up from its peak finds the lowest word the stack has touched
+
+    uint32_t *p = (uint32_t *) (((uintptr_t) _brk_max + 3) & ~3);
+
+    while ((p < &_stack) && (*p == MEM_PAINT)) p++;
+
+    usage->data = (char *) &_edata - (char *) &_data;
+    usage->bss = (char *) &_ebss - (char *) &_edata;
+    usage->heap = _brk - (char *) &end;
+    usage->heap_max = _brk_max - (char *) &end;
+    usage->stack_max = (char *) &_stack - (char *) p;
+    usage->stack_size = (char *) &_stack - _brk_max;
+    usage->free = (char *) p - _brk_max;
+
+}
+
+void mem_update_metrics(void) {
+
+    struct mem_usage usage;
+
+    mem_get_usage(&usage);
+
+    metrics_set(METRIC_MEM_STATIC_BYTES, usage.data + usage.bss);
+    metrics_set(METRIC_MEM_HEAP_BYTES, usage.heap);
+    metrics_set(METRIC_MEM_HEAP_MAX_BYTES, usage.heap_max);
+    metrics_set(METRIC_MEM_STACK_MAX_BYTES, usage.stack_max);
+    metrics_set(METRIC_MEM_FREE_BYTES, usage.free);
+
+}
+
+void *_sbrk(ptrdiff_t incr) {
+
+    // replaces the one in libnosys, so we can keep count (newlib's printf
+    // mallocs its buffers), and so the heap can't silently run into the stack
+
+    char *prev = _brk;
+
+    if (_brk + incr > _get_sp() - MEM_STACK_RESERVE) {
+        errno = ENOMEM;
+        return (void *) -1;
+    }
+
+    _brk += incr;
+    if (_brk > _brk_max) _brk_max = _brk;
+
+    return prev;
+
+}
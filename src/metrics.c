@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "metrics.h"
+
+static uint32_t _metrics[METRIC_COUNT];
+
+static const char *_names[METRIC_COUNT] = {
+    [METRIC_BOOT_TO_READY_MS] = "boot_to_ready_ms",
+    [METRIC_BOOT_TO_REGISTERED_MS] = "boot_to_registered_ms",
+    [METRIC_BOOT_TO_FIRST_UPLOAD_MS] = "boot_to_first_upload_ms",
+    [METRIC_MODEM_BAUDRATE] = "modem_baudrate",
+    [METRIC_MODEM_BAUD_FALLBACKS] = "modem_baud_fallbacks",
+    [METRIC_MODEM_RX_BYTES] = "modem_rx_bytes",
+    [METRIC_MODEM_RX_BYTES_PER_S] = "modem_rx_bytes_per_s",
+    [METRIC_MODEM_LINE_ERRORS] = "modem_line_errors",
+    [METRIC_CLOCK_4MHZ_MS] = "clock_4mhz_ms",
+    [METRIC_CLOCK_16MHZ_MS] = "clock_16mhz_ms",
+    [METRIC_CLOCK_32MHZ_MS] = "clock_32mhz_ms",
+    [METRIC_MEM_STATIC_BYTES] = "mem_static_bytes",
+    [METRIC_MEM_HEAP_BYTES] = "mem_heap_bytes",
+    [METRIC_MEM_HEAP_MAX_BYTES] = "mem_heap_max_bytes",
+    [METRIC_MEM_STACK_MAX_BYTES] = "mem_stack_max_bytes",
+    [METRIC_MEM_FREE_BYTES] = "mem_free_bytes",
+    [METRIC_MODEM_AT_COMMANDS] = "modem_at_commands",
+    [METRIC_MODEM_AT_TIMEOUTS] = "modem_at_timeouts",
+    [METRIC_MODEM_AT_LATENCY_TOTAL_MS] = "modem_at_latency_total_ms",
+    [METRIC_MODEM_AT_LATENCY_MAX_MS] = "modem_at_latency_max_ms",
+    [METRIC_SERIAL_RX_MAX_DEPTH] = "serial_rx_max_depth",
+    [METRIC_SERIAL_RX_OVERFLOWS] = "serial_rx_overflows",
+    [METRIC_RESET_CAUSE] = "reset_cause",
+    [METRIC_RESETS_WATCHDOG] = "resets_watchdog",
+    [METRIC_RECOVERY_MS] = "recovery_ms",
+    [METRIC_TIME_SYNCS] = "time_syncs",
+    [METRIC_TIME_CORRECTION_MS] = "time_correction_ms",
+    [METRIC_TLS_HANDSHAKES] = "tls_handshakes",
+    [METRIC_UPLOADS] = "uploads",
+    [METRIC_UPLOAD_LATENCY_TOTAL_MS] = "upload_latency_total_ms",
+    [METRIC_UPLOAD_LATENCY_MAX_MS] = "upload_latency_max_ms",
+    [METRIC_SENSORS] = "sensors",
+    [METRIC_SENSOR_ERRORS] = "sensor_errors",
+    [METRIC_SENSOR_READ_US] = "sensor_read_us",
+    [METRIC_UPLOADS_DEFERRED] = "uploads_deferred",
+};
+
+void metrics_set(metric_t m, uint32_t value) {
+
+    _metrics[m] = value;
+
+}
+
+void metrics_add(metric_t m, uint32_t value) {
+
+    _metrics[m] += value;
+
+}
+
+uint32_t metrics_get(metric_t m) {
+
+    return _metrics[m];
+
+}
+
+void metrics_print(void) {
+
+    for (int i=0; i<METRIC_COUNT; i++) {
+        printf("%s = %lu\n", _names[i], (unsigned long) _metrics[i]);
+    }
+
+}
@@ -1,23 +1,20 @@
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/cm3/systick.h>
+#include <libopencm3/cm3/cortex.h>
 
 #include "millis.h"
 
 extern void sys_tick_handler(void);
 
 static volatile uint64_t _millis = 0;
+static uint32_t _frac_us = 0;   // carried over from partial ms at clock changes
 
 void millis_setup(void) {
 
     // Set the systick clock source to our main clock
     systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
 
-    // Clear the Current Value Register so that we start at 0
-    STK_CVR = 0;
-
-    // In order to trigger an interrupt every millisecond, we can set the reload
-    // value to be the speed of the processor / 1000 - 1
-    systick_set_reload(rcc_ahb_frequency / 1000 - 1);
+    millis_clock_changed();
 
     // Enable interrupts from the system tick clock
     systick_interrupt_enable();
@@ -27,6 +24,40 @@ void millis_setup(void) {
 
 }
 
+void millis_clock_changed(void) {
+
+    // The Current Value Register can't be rescaled, writing it only clears
+    // it, which throws away however much of the current millisecond had gone
+    // by. That part is kept in _frac_us instead and carried into _millis once
+    // it adds up to a whole one; otherwise millis() runs slow by up to 1 ms
+    // per clock change. (The few ticks since the switch are counted at the
+    // old rate, which is close enough.)
+
+    uint32_t reload = systick_get_reload();
+    uint32_t elapsed, primask;
+
+    // may be called with interrupts already off, which is how they're left
+    primask = cm_mask_interrupts(1);
+
+    if (reload) {   // 0 before millis_setup() has run
+        elapsed = reload - systick_get_value();
+        _frac_us += (uint64_t) elapsed * 1000 / (reload + 1);
+        if (_frac_us >= 1000) {
+            _millis++;
+            _frac_us -= 1000;
+        }
+    }
+
+    STK_CVR = 0;
+
+    // In order to trigger an interrupt every millisecond, we can set the reload
+    // value to be the speed of the processor / 1000 - 1
+    systick_set_reload(rcc_ahb_frequency / 1000 - 1);
+
+    cm_mask_interrupts(primask);
+
+}
+
 void sys_tick_handler(void) {
 
     _millis++;
@@ -8,20 +8,58 @@
 
 #include "modem.h"
 #include "millis.h"
+#include "metrics.h"
+#include "nvm.h"
+#include "watchdog.h"
+#include "atparse.h"
 
 // global buffers
 uint8_t MODEM_BUF[MODEM_BUF_SIZE];
 size_t MODEM_BUF_IDX = 0;
 
+// identity and network config, mirrored in NVM_SLOT_MODEM
+static struct modem_identity _identity;
+
+// HTTPS session (AT+SH*), see modem_https_connect()
+static bool _sh_connected = false;
+
+// link state
+static uint32_t _baudrate = MODEM_DEFAULT_BAUD;
+static bool _flow_control = false;
+static bool _parked = false;    // see modem_clock_changed()
+static const uint32_t _baudrates[] = {921600, 460800, 230400, 115200};
+#define N_BAUDRATES (sizeof(_baudrates) / sizeof(_baudrates[0]))
+
+// throughput accounting, see _get_byte(); the metrics are only brought up
+// to date between bursts, see modem_update_metrics()
+static uint64_t _rx_last_ms = 0;
+static uint32_t _rx_bytes = 0;  // not yet in METRIC_MODEM_RX_BYTES
+static uint32_t _rx_burst_bytes = 0;
+static uint32_t _rx_burst_ms = 0;
+
+// AT latency accounting: time from sending a command to its first byte back
+static uint64_t _cmd_sent_ms = 0;
+static bool _cmd_pending = false;
+
 // forward declarations
 static void _send_command(const char*);
+static void _begin_command(void);
+static void _send_raw(const char*);
+static void _end_command(void);
 static bool _wait_for_char(const char, uint64_t);
 static bool _get_byte(uint8_t*, uint64_t);
 static bool _confirm_response(const char*, uint64_t);
 static bool _send_confirm(const char*, const char*, uint64_t);
 static bool _get_data(size_t, uint64_t);
 static bool _get_variable_length_response(uint64_t);
+static bool _get_line(uint64_t);
 static void _flush_rx(void);
+static void _set_baudrate(uint32_t);
+static void _set_flow_control(bool);
+static bool _link_check(void);
+static bool _apply_setting(const char*, uint8_t);
+static bool _http_init(const char*);
+static int32_t _days_from_civil(int32_t, uint32_t, uint32_t);
 
 void modem_setup(void) {
 
@@ -35,12 +73,12 @@ void modem_setup(void) {
     // configure USART2 on PA2 (TX) and PA3 (RX)
     gpio_mode_setup(GPIOA, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO2 | GPIO3);
     gpio_set_af(GPIOA, GPIO_AF7, GPIO2 | GPIO3);
-    usart_set_baudrate(USART2, 115200);
+    usart_set_baudrate(USART2, _baudrate);
     usart_set_databits(USART2, 8);
     usart_set_parity(USART2, USART_PARITY_NONE);
     usart_set_stopbits(USART2, USART_CR2_STOPBITS_1);
-    usart_set_flow_control(USART2, USART_FLOWCONTROL_NONE);
     usart_set_mode(USART2, USART_MODE_TX_RX);   // duplex
+    _set_flow_control(false);   // until modem_negotiate_baudrate()
     usart_enable(USART2);
 
     // configure GPIO pins
@@ -58,43 +96,213 @@ void modem_setup(void) {
 
 bool modem_init(void) {
 
+    // The network config and identity are cached in EEPROM, keyed on the
+    // IMEI. If this is the modem we configured last time, nothing needs
+    // redoing. Otherwise the config is only written where the modem reports
+    // something different, because writing AT+CNMP/AT+CMNB restarts the
+    // network search even if the value is unchanged.
+
+    struct modem_identity cached;
+
     // disable echo
     if (!_send_confirm("ATE0", "OK", 100)) return false;
 
-    // TODO figure out these preferred modes
+    if (!modem_get_imei()) return false;
+
+    if (nvm_load(NVM_SLOT_MODEM, &cached, sizeof(cached))
+            && !strcmp(cached.imei, (const char *) MODEM_BUF)
+            && (cached.mode == MODEM_PREFERRED_MODE)
+            && (cached.cat == MODEM_PREFERRED_CAT)
+            && (cached.clts == 1)) {
+        _identity = cached;
+        return true;
+    }
+
+    memset(&_identity, 0, sizeof(_identity));
+    strcpy(_identity.imei, (const char *) MODEM_BUF);
+
+    // TODO figure out these preferred modes, see MODEM_PREFERRED_MODE and
+    // MODEM_PREFERRED_CAT
+    if (!_apply_setting("AT+CNMP", MODEM_PREFERRED_MODE)) return false;
+    if (!_apply_setting("AT+CMNB", MODEM_PREFERRED_CAT)) return false;
+    _identity.mode = MODEM_PREFERRED_MODE;
+    _identity.cat = MODEM_PREFERRED_CAT;
+
+    // have the network set the modem's clock, see modem_get_network_time()
+    // this only takes effect once saved and the modem restarted
+    if (!_apply_setting("AT+CLTS", 1)) return false;
+    if (!_send_confirm("AT&W", "OK", 1000)) return false;
+    _identity.clts = 1;
+
+    // IMSI and firmware version are filled in by modem_refresh_identity()
+    nvm_store(NVM_SLOT_MODEM, &_identity, sizeof(_identity));
+
+    return true;
+
+}
+
+bool modem_refresh_identity(void) {
+
+    // one attempt at each of the slower identity queries, so that the main
+    // loop can interleave them with registration instead of blocking on them
+    // (the SIM may not answer AT+CIMI until it has settled).
+    // Only touches the EEPROM if something changed, e.g. a swapped SIM.
+
+    bool changed = false;
+
+    if (!modem_get_imsi()) return false;
+    if (strcmp(_identity.imsi, (const char *) MODEM_BUF)) {
+        strcpy(_identity.imsi, (const char *) MODEM_BUF);
+        changed = true;
+    }
 
-    // preferred mode
-    //if (!_send_confirm("AT+CNMP=2", "OK", 1000)) return false;  // automatic
-    //if (!_send_confirm("AT+CNMP=13", "OK", 1000)) return false; // GSM only
-    if (!_send_confirm("AT+CNMP=38", "OK", 1000)) return false; // LTE only
-    //if (!_send_confirm("AT+CNMP=51", "OK", 1000)) return false; // GSM and LTE only
+    if (!_identity.firmware[0]) {   // only changes with a modem update
+        if (!modem_get_firmware_version()) return false;
+        strcpy(_identity.firmware, (const char *) MODEM_BUF);
+        changed = true;
+    }
 
-    // preferred selection between cat-m and nb-iot
-    if (!_send_confirm("AT+CMNB=1", "OK", 1000)) return false;  // cat-M
-    //if (!_send_confirm("AT+CMNB=2", "OK", 1000)) return false;  // NB-IOT
-    //if (!_send_confirm("AT+CMNB=3", "OK", 1000)) return false;  // cat-M and NB-IOT
+    if (changed) {
+        nvm_store(NVM_SLOT_MODEM, &_identity, sizeof(_identity));
+    }
 
     return true;
 
 }
 
+char *modem_imei_str(void) {
+
+    return _identity.imei;
+
+}
+
+char *modem_imsi_str(void) {
+
+    return _identity.imsi;
+
+}
+
+char *modem_firmware_str(void) {
+
+    return _identity.firmware;
+
+}
+
 bool modem_wait_until_ready(uint64_t timeout) {
 
     // ideally we would just poll the STATUS line, but it is not broken out
     // so instead we send ATE0 until we get a response (or timeout)
 
+    // the modem keeps its AT+IPR setting across resets, so if it doesn't
+    // answer at the current rate we cycle through the others
+
     uint64_t until;
+    size_t i = 0;
 
     until = millis() + timeout;
 
     while(millis() < until) {
-        if (_send_confirm("ATE0", "OK", 100)) return true;
+        if (_send_confirm("ATE0", "OK", 100)) {
+            metrics_set(METRIC_MODEM_BAUDRATE, _baudrate);
+            return true;
+        }
+        _set_baudrate(_baudrates[i++ % N_BAUDRATES]);
     }
 
     return false;
 
 }
 
+bool modem_negotiate_baudrate(void) {
+
+    // switch to RTS/CTS and step the link up to the fastest rate that both
+    // ends sustain. The modem answers AT+IPR at the old rate and then
+    // switches, so each candidate is verified with _link_check() and, if it
+    // shows framing errors or drops responses, we ask the modem to go back
+    // and try the next one down.
+
+    // NOTE: at 16 MHz, 921600 comes out ~2% fast, which the modem may or may
+    // not tolerate; that's what the fallback is for
+
+    char ATstring[20];
+    uint32_t prev;
+
+    if (!_send_confirm("AT+IFC=2,2", "OK", 1000)) return false;
+    _set_flow_control(true);
+
+    for (size_t i=0; i<N_BAUDRATES; i++) {
+
+        if (_baudrates[i] == _baudrate) break;  // already there
+
+        sprintf(ATstring, "AT+IPR=%lu", (unsigned long) _baudrates[i]);
+        if (!_send_confirm(ATstring, "OK", 1000)) continue;
+
+        prev = _baudrate;
+        _set_baudrate(_baudrates[i]);
+        if (_link_check()) break;
+
+        // the modem may or may not understand us at this rate, so we say
+        // it anyway and then confirm at the old rate
+        printf("[WARNING] modem link unreliable at %lu baud\n", (unsigned long) _baudrate);
+        metrics_add(METRIC_MODEM_BAUD_FALLBACKS, 1);
+        sprintf(ATstring, "AT+IPR=%lu", (unsigned long) prev);
+        _send_command(ATstring);
+        millis_delay(MODEM_CTO_MS);
+        _set_baudrate(prev);
+        if (!modem_wait_until_ready(1000)) return false;
+
+    }
+
+    metrics_set(METRIC_MODEM_BAUDRATE, _baudrate);
+
+    return true;
+
+}
+
+void modem_update_metrics(void) {
+
+    // fold what _get_byte() has counted into the link metrics; call before
+    // reading them
+
+    metrics_add(METRIC_MODEM_RX_BYTES, _rx_bytes);
+    _rx_bytes = 0;
+
+    if (_rx_burst_ms) {
+        metrics_set(METRIC_MODEM_RX_BYTES_PER_S,
+                    (uint64_t) _rx_burst_bytes * 1000 / _rx_burst_ms);
+    }
+
+}
+
+uint32_t modem_get_baudrate(void) {
+
+    return _baudrate;
+
+}
+
+void modem_clock_changed(void) {
+
+    // USART2 needs at least 16 bus clocks per bit, which the idle clock can't
+    // give the faster rates. In that case we deassert RTS so the modem holds
+    // on to anything it has for us until we're back at speed.
+    // Without flow control we're at a rate every clock can make.
+
+    if (_flow_control && (rcc_apb1_frequency < 16 * _baudrate)) {
+        gpio_mode_setup(GPIOA, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, GPIO1);
+        gpio_set(GPIOA, GPIO1);
+        _parked = true;
+        return;
+    }
+
+    _set_baudrate(_baudrate);
+
+    if (_parked) {
+        _set_flow_control(_flow_control);
+        _parked = false;
+    }
+
+}
+
 void modem_power_up(void) {
 
     // pulse low for 100 ms
@@ -271,6 +479,97 @@ bool modem_get_functionality(uint8_t *status) {
 
 }
 
+bool modem_query(const char **cmds, size_t n) {
+
+    // Run several read-only commands in one round trip, e.g.
+    //   cmds = {"+CFUN?", "+CSQ"}  ->  "AT+CFUN?;+CSQ"
+    // The information lines of all responses are stored one after another
+    // in MODEM_BUF as null-terminated strings, ending with an empty one.
+    // Look them up with modem_query_find(). Fails if any command errors.
+
+    char line[MODEM_QUERY_LEN];
+    size_t len = 2;
+    size_t start;
+
+    strcpy(line, "AT");
+    for (size_t i=0; i<n; i++) {
+        if (len + 1 + strlen(cmds[i]) >= sizeof(line)) {
+            printf("[ERROR] modem_query: line too long\n");
+            return false;
+        }
+        if (i) line[len++] = ';';
+        strcpy(line + len, cmds[i]);
+        len += strlen(cmds[i]);
+    }
+
+    _send_command(line);
+
+    MODEM_BUF_IDX = 0;
+    while (1) {
+
+        start = MODEM_BUF_IDX;
+        if (!_get_line(1000)) return false;
+
+        if (!strcmp((const char *) (MODEM_BUF + start), "OK")) {
+            MODEM_BUF[start] = '\0';   // end of list
+            return true;
+        }
+        if (strstr((const char *) (MODEM_BUF + start), "ERROR")) return false;
+        if (MODEM_BUF_IDX >= MODEM_BUF_SIZE - 1) return false;  // full
+
+    }
+
+}
+
+const char *modem_query_find(const char *prefix) {
+
+    // returns the first line from the last modem_query() starting with prefix,
+    // or NULL
+
+    const char *line = (const char *) MODEM_BUF;
+    size_t n = strlen(prefix);
+
+    while (*line) {
+        if (!strncmp(line, prefix, n)) return line;
+        line += strlen(line) + 1;
+    }
+
+    return NULL;
+
+}
+
+bool modem_get_vitals(struct modem_vitals *vitals) {
+
+    // the same as modem_get_functionality(), modem_get_rssi_ber(),
+    // modem_get_network_registration() and modem_get_network_system_mode(),
+    // in a single round trip. vitals is untouched on failure.
+
+    static const char *cmds[] = {"+CFUN?", "+CSQ", "+CGREG?", "+CNSMOD?"};
+    const char *fun, *csq, *cgreg, *cnsmod;
+    char *comma;
+
+    if (!modem_query(cmds, sizeof(cmds) / sizeof(cmds[0]))) return false;
+
+    // +CFUN: <fun>
+    // +CSQ: <rssi>,<ber>
+    // +CGREG: <n>,<stat>
+    // +CNSMOD: <n>,<stat>
+    if (!(fun = modem_query_find("+CFUN: "))) return false;
+    if (!(csq = modem_query_find("+CSQ: "))) return false;
+    if (!(cgreg = modem_query_find("+CGREG: "))) return false;
+    if (!(cnsmod = modem_query_find("+CNSMOD: "))) return false;
+    if (!strchr(csq, ',') || !strchr(cgreg, ',') || !strchr(cnsmod, ',')) return false;
+
+    vitals->functionality = strtol(fun + 7, NULL, 10);
+    vitals->rssi = strtol(csq + 6, &comma, 10);
+    vitals->ber = strtol(comma + 1, NULL, 10);
+    vitals->registration = strtol(strchr(cgreg, ',') + 1, NULL, 10);
+    vitals->system_mode = strtol(strchr(cnsmod, ',') + 1, NULL, 10);
+
+    return true;
+
+}
+
 bool modem_get_available_networks(void) {
 
     // after calling, retrieve the result with modem_get_buffer();
@@ -286,6 +585,53 @@ bool modem_get_available_networks(void) {
 }
 
 
+//// time
+
+
+bool modem_get_network_time(uint64_t *epoch_ms) {
+
+    // UTC in ms since the epoch, from the modem's clock. Fails if the clock
+    // hasn't been set by the network or NTP yet (it starts at 1980)
+
+    // +CCLK: "yy/MM/dd,hh:mm:ss+zz"
+    // local time, with the offset from UTC in quarter hours
+
+    int yy, MM, dd, hh, mm, ss, zz;
+    int64_t seconds;
+
+    _send_command("AT+CCLK?");
+    if (!_get_variable_length_response(1000)) return false;
+    if (sscanf((const char *) MODEM_BUF, "+CCLK: \"%d/%d/%d,%d:%d:%d%d\"",
+               &yy, &MM, &dd, &hh, &mm, &ss, &zz) != 7) return false;
+    if (!_confirm_response("OK", 1000)) return false;
+
+    if ((yy < 20) || (yy >= 80)) return false;  // not set
+
+    seconds = (int64_t) _days_from_civil(2000 + yy, MM, dd) * 86400
+              + hh * 3600 + mm * 60 + ss - zz * 900;
+    *epoch_ms = seconds * 1000;
+
+    return true;
+
+}
+
+bool modem_ntp_sync(const char *server) {
+
+    // set the modem's clock from NTP over bearer 1 (see
+    // modem_connect_bearer()), read it back with modem_get_network_time()
+
+    char ATstring[MODEM_AT_LEN];
+
+    if (!_send_confirm("AT+CNTPCID=1", "OK", 1000)) return false;
+    snprintf(ATstring, sizeof(ATstring), "AT+CNTP=\"%s\",0", server);
+    if (!_send_confirm(ATstring, "OK", 1000)) return false;
+    if (!_send_confirm("AT+CNTP", "OK", 1000)) return false;
+
+    return _confirm_response("+CNTP: 1", 10000);
+
+}
+
+
 //// GPS
 
 
@@ -311,17 +657,29 @@ bool modem_gps_get_nav(void) {
 //// internets
 
 
-bool modem_connect_bearer(void) {
+bool modem_connect_bearer(const char *apn, const char *user, const char *pwd) {
+
+    // Safe to retry: AT+CSTT and AT+CIICR only work from IP INITIAL, and
+    // AT+SAPBR=1,1 fails if the bearer is still open, so whatever is left
+    // of an earlier connection is shut down first.
+
+    char ATstring[MODEM_AT_LEN];
 
     // attach service
     if (!_send_confirm("AT+CGATT=1", "OK", 1000)) return false;
-    if (!_send_confirm("AT+CSTT=\"soracom.io\",\"sora\",\"sora\"", "OK", 1000)) return false;
+    if (!_send_confirm("AT+CIPSHUT", "SHUT OK", 10000)) return false;
+    snprintf(ATstring, sizeof(ATstring), "AT+CSTT=\"%s\",\"%s\",\"%s\"", apn, user, pwd);
+    if (!_send_confirm(ATstring, "OK", 1000)) return false;
     if (!_send_confirm("AT+CIICR", "OK", 1000)) return false;
 
     // IP bearer
-    if (!_send_confirm("AT+SAPBR=3,1,\"APN\",\"soracom.io\"", "OK", 1000))  return false;
-    if (!_send_confirm("AT+SAPBR=3,1,\"USER\",\"sora\"", "OK", 1000)) return false;
-    if (!_send_confirm("AT+SAPBR=3,1,\"PWD\",\"sora\"", "OK", 1000)) return false;
+    snprintf(ATstring, sizeof(ATstring), "AT+SAPBR=3,1,\"APN\",\"%s\"", apn);
+    if (!_send_confirm(ATstring, "OK", 1000))  return false;
+    snprintf(ATstring, sizeof(ATstring), "AT+SAPBR=3,1,\"USER\",\"%s\"", user);
+    if (!_send_confirm(ATstring, "OK", 1000)) return false;
+    snprintf(ATstring, sizeof(ATstring), "AT+SAPBR=3,1,\"PWD\",\"%s\"", pwd);
+    if (!_send_confirm(ATstring, "OK", 1000)) return false;
+    _send_confirm("AT+SAPBR=0,1", "OK", 1000);     // ERROR if it was closed
     if (!_send_confirm("AT+SAPBR=1,1", "OK", 1000)) return false;
 
     // this will provide your IP address, if desired
@@ -331,33 +689,267 @@ bool modem_connect_bearer(void) {
 
 }
 
-bool modem_post_temperature(float temp) {
+bool modem_http_post(const char *url, const char *payload) {
 
     // HTTP POST
 
-    char ATstring[30];
-    char payload[30];
+    char ATstring[MODEM_AT_LEN];
 
-    if (!_send_confirm("AT+HTTPINIT", "OK", 1000)) return false;
+    if (!_http_init(url)) return false;
 
-    if (!_send_confirm("AT+HTTPPARA=\"CID\",1", "OK", 1000)) return false;
-    if (!_send_confirm("AT+HTTPPARA=\"URL\",\"http://demo.thingsboard.io/api/v1/K11HoE3QMPE7rSHPf3Hj/telemetry\"", "OK", 1000)) return false;
-
-    sprintf(payload, "{\"temperature\": %.3f}", temp);
-    sprintf(ATstring, "AT+HTTPDATA=%d,10000", strlen(payload));  // do i need *any* delay here?
-    if (!_send_confirm(ATstring, "DOWNLOAD", 5000)) return false;
+    snprintf(ATstring, sizeof(ATstring), "AT+HTTPDATA=%u,10000", (unsigned) strlen(payload));  // do i need *any* delay here?
+    if (!_send_confirm(ATstring, "DOWNLOAD", 5000)) goto fail;
     millis_delay(1000); // how short can this be?
-    if (!_send_confirm(payload, "OK", 5000)) return false;
+    if (!_send_confirm(payload, "OK", 5000)) goto fail;
 
-    if (!_send_confirm("AT+HTTPACTION=1", "OK", 1000)) return false;
-    if (!_confirm_response("+HTTPACTION: 1,200,0", 2000)) return false;
+    if (!_send_confirm("AT+HTTPACTION=1", "OK", 1000)) goto fail;
+    if (!_confirm_response("+HTTPACTION: 1,200,0", 2000)) goto fail;
 
     if (!_send_confirm("AT+HTTPTERM", "OK", 1000)) return false;
 
     return true;
 
+fail:
+    // otherwise every AT+HTTPINIT from now on fails
+    _send_confirm("AT+HTTPTERM", "OK", 1000);
+    return false;
+
+}
+
+bool modem_http_get(const char *url) {
+
+    // HTTP GET, the response body is stored null terminated in MODEM_BUF
+    // (and truncated to fit)
+
+    char ATstring[24];
+    size_t len;
+
+    if (!_http_init(url)) return false;
+
+    if (!_send_confirm("AT+HTTPACTION=0", "OK", 1000)) goto fail;
+
+    // +HTTPACTION: 0,<status>,<len>
+    if (!_get_variable_length_response(5000)) goto fail;
+    if (strncmp((const char *) MODEM_BUF, "+HTTPACTION: 0,200,", 19)) goto fail;
+    len = strtol((const char *) (MODEM_BUF + 19), NULL, 10);
+    if (len > MODEM_BUF_SIZE - 1) len = MODEM_BUF_SIZE - 1;
+
+    // +HTTPREAD: <len>, then the body itself, unframed
+    snprintf(ATstring, sizeof(ATstring), "AT+HTTPREAD=0,%u", (unsigned) len);
+    _send_command(ATstring);
+    if (!_get_variable_length_response(1000)) goto fail;
+    if (strncmp((const char *) MODEM_BUF, "+HTTPREAD: ", 11)) goto fail;
+    len = strtol((const char *) (MODEM_BUF + 11), NULL, 10);
+    if (len > MODEM_BUF_SIZE - 1) goto fail;
+
+    for (size_t i=0; i<len; i++) {
+        if (!_get_byte(MODEM_BUF + i, MODEM_CTO_MS)) goto fail;
+    }
+    MODEM_BUF[len] = '\0';
+    MODEM_BUF_IDX = len;
+
+    if (!_confirm_response("OK", 1000)) goto fail;
+
+    // the body is left alone in MODEM_BUF
+    return _send_confirm("AT+HTTPTERM", "OK", 1000);
+
+fail:
+    // otherwise every AT+HTTPINIT from now on fails
+    _send_confirm("AT+HTTPTERM", "OK", 1000);
+    return false;
+
+}
+
+//// HTTPS
+//
+// Uses the modem's own HTTP(S) client (AT+SH*), which unlike AT+HTTP* keeps
+// the TLS connection open between requests, so the handshake is paid once
+// per connection rather than once per post. It runs on the app network
+// (AT+CNACT) rather than the AT+SAPBR bearer.
+
+
+bool modem_connect_app_network(const char *apn) {
+
+    // the app network HTTPS runs on, activated unless it already is
+
+    char ATstring[MODEM_AT_LEN];
+
+    // +CNACT: <status>,<ip_addr>
+    _send_command("AT+CNACT?");
+    if (!_get_variable_length_response(1000)) return false;
+    if (!_confirm_response("OK", 1000)) return false;
+    if (!strncmp((const char *) MODEM_BUF, "+CNACT: 1", 9)) return true;
+
+    snprintf(ATstring, sizeof(ATstring), "AT+CNACT=1,\"%s\"", apn);
+    if (!_send_confirm(ATstring, "OK", 1000)) return false;
+
+    return _confirm_response("+APP PDP: ACTIVE", 10000);
+
+}
+
+bool modem_https_connect(const char *host, const char *ca) {
+
+    // ca is the name of a certificate loaded with modem_tls_load_ca(), or ""
+    // to encrypt without verifying the server. Needs the app network, see
+    // modem_connect_app_network()
+
+    char ATstring[MODEM_AT_LEN];
+
+    modem_https_disconnect();
+
+    snprintf(ATstring, sizeof(ATstring), "AT+SHCONF=\"URL\",\"https://%s\"", host);
+    if (!_send_confirm(ATstring, "OK", 1000)) return false;
+    if (!_send_confirm("AT+SHCONF=\"BODYLEN\",1024", "OK", 1000)) return false;
+    if (!_send_confirm("AT+SHCONF=\"HEADERLEN\",350", "OK", 1000)) return false;
+    if (!_send_confirm("AT+CSSLCFG=\"sslversion\",1,3", "OK", 1000)) return false; // TLS 1.2
+    snprintf(ATstring, sizeof(ATstring), "AT+SHSSL=1,\"%s\"", ca);
+    if (!_send_confirm(ATstring, "OK", 1000)) return false;
+
+    // the handshake
+    metrics_add(METRIC_TLS_HANDSHAKES, 1);
+    if (!_send_confirm("AT+SHCONN", "OK", 15000)) return false;
+
+    // headers last for the whole connection
+    if (!_send_confirm("AT+SHCHEAD", "OK", 1000)) return false;
+    if (!_send_confirm("AT+SHAHEAD=\"Content-Type\",\"application/json\"", "OK", 1000)) return false;
+    if (!_send_confirm("AT+SHAHEAD=\"Connection\",\"keep-alive\"", "OK", 1000)) return false;
+
+    _sh_connected = true;
+
+    return true;
+
+}
+
+void modem_https_disconnect(void) {
+
+    // harmless if there's no connection
+
+    if (_sh_connected) {
+        _send_confirm("AT+SHDISC", "OK", 1000);
+        _sh_connected = false;
+    }
+
+}
+
+bool modem_https_connected(void) {
+
+    return _sh_connected;
+
+}
+
+bool modem_https_post(const char *path, const char *payload) {
+
+    // on failure the connection is dropped, so the caller knows to
+    // reconnect with modem_https_connect()
+
+    char ATstring[MODEM_AT_LEN];
+    char c[3] = {0};
+    uint32_t status, len;
+
+    if (!_sh_connected) return false;
+
+    // the body goes inline as a quoted string, with its quotes escaped
+    _begin_command();
+    _send_raw("AT+SHBOD=\"");
+    for (const char *p = payload; *p; p++) {
+        c[0] = *p;
+        c[1] = '\0';
+        if ((*p == '"') || (*p == '\\')) {
+            c[0] = '\\';
+            c[1] = *p;
+        }
+        _send_raw(c);
+    }
+    snprintf(ATstring, sizeof(ATstring), "\",%u", (unsigned) strlen(payload));
+    _send_raw(ATstring);
+    _end_command();
+    if (!_confirm_response("OK", 1000)) goto fail;
+
+    snprintf(ATstring, sizeof(ATstring), "AT+SHREQ=\"%s\",3", path);  // 3 = POST
+    if (!_send_confirm(ATstring, "OK", 1000)) goto fail;
+
+    // +SHREQ: "POST",<status>,<len>
+    if (!_get_variable_length_response(10000)) goto fail;
+    if (!atparse_shreq((const char *) MODEM_BUF, "POST", &status, &len)) goto fail;
+    if (status != 200) goto fail;
+
+    return true;
+
+fail:
+    modem_https_disconnect();
+    return false;
+
 }
 
+bool modem_https_get(const char *path) {
+
+    // like modem_http_get(), the body is left null terminated in MODEM_BUF
+
+    char ATstring[MODEM_AT_LEN];
+    uint32_t status, len;
+
+    if (!_sh_connected) return false;
+
+    snprintf(ATstring, sizeof(ATstring), "AT+SHREQ=\"%s\",1", path);  // 1 = GET
+    if (!_send_confirm(ATstring, "OK", 1000)) goto fail;
+
+    // +SHREQ: "GET",<status>,<len>
+    if (!_get_variable_length_response(10000)) goto fail;
+    if (!atparse_shreq((const char *) MODEM_BUF, "GET", &status, &len)) goto fail;
+    if (status != 200) goto fail;
+    if (len > MODEM_BUF_SIZE - 1) len = MODEM_BUF_SIZE - 1;
+
+    // OK, then +SHREAD: <len> and the body itself, unframed
+    snprintf(ATstring, sizeof(ATstring), "AT+SHREAD=0,%u", (unsigned) len);
+    if (!_send_confirm(ATstring, "OK", 1000)) goto fail;
+    if (!_get_variable_length_response(5000)) goto fail;
+    if (strncmp((const char *) MODEM_BUF, "+SHREAD: ", 9)) goto fail;
+    len = strtol((const char *) (MODEM_BUF + 9), NULL, 10);
+    if (len > MODEM_BUF_SIZE - 1) goto fail;
+
+    for (size_t i=0; i<len; i++) {
+        if (!_get_byte(MODEM_BUF + i, MODEM_CTO_MS)) goto fail;
+    }
+    MODEM_BUF[len] = '\0';
+    MODEM_BUF_IDX = len;
+
+    return true;
+
+fail:
+    modem_https_disconnect();
+    return false;
+
+}
+
+bool modem_tls_load_ca(const char *name, const char *pem) {
+
+    // write a PEM CA certificate to the modem's filesystem and convert it
+    // for use by modem_https_connect()
+
+    char ATstring[MODEM_AT_LEN];
+    bool ok;
+
+    if (!_send_confirm("AT+CFSINIT", "OK", 1000)) return false;
+
+    // 3 = /customer/, 0 = overwrite
+    snprintf(ATstring, sizeof(ATstring), "AT+CFSWFILE=3,\"%s\",0,%u,10000",
+             name, (unsigned) strlen(pem));
+    ok = _send_confirm(ATstring, "DOWNLOAD", 1000);
+    if (ok) {
+        _send_raw(pem);
+        ok = _confirm_response("OK", 10000);
+    }
+
+    _send_confirm("AT+CFSTERM", "OK", 1000);
+    if (!ok) return false;
+
+    snprintf(ATstring, sizeof(ATstring), "AT+CSSLCFG=\"convert\",2,\"%s\"", name);
+
+    return _send_confirm(ATstring, "OK", 5000);
+
+}
+
+
 bool modem_query_bearer(void) {
 
     // result is stored in MODEM_BUF
@@ -387,16 +979,40 @@ static void _send_command(const char *cmd) {
 
     // handles \r and \n, no need to include them in the argument
 
+    _begin_command();
+    _send_raw(cmd);
+    _end_command();
+
+}
+
+static void _begin_command(void) {
+
+    // for commands too long to build in one piece, send them with
+    // _begin_command(), _send_raw() as often as needed, and _end_command()
+
+    watchdog_service();
     _flush_rx();
 
-    while (*cmd) {
-        usart_send_blocking(USART2, *cmd);
-        cmd++;
+}
+
+static void _send_raw(const char *s) {
+
+    while (*s) {
+        usart_send_blocking(USART2, *s);
+        s++;
     }
 
+}
+
+static void _end_command(void) {
+
     usart_send_blocking(USART2, '\r');
     usart_send_blocking(USART2, '\n');
 
+    metrics_add(METRIC_MODEM_AT_COMMANDS, 1);
+    _cmd_sent_ms = millis();
+    _cmd_pending = true;
+
 }
 
 static bool _wait_for_char(const char c, uint64_t timeout) {
@@ -405,41 +1021,66 @@ static bool _wait_for_char(const char c, uint64_t timeout) {
     // or timeout occurs (return false)
     // or something other than c is received (return false)
 
-    uint64_t until;
-    char r; // received
+    uint8_t r; // received
 
-    until = millis() + timeout;
+    if (!_get_byte(&r, timeout)) return false;
 
-    while (1) {
-
-        if (millis() >= until) {
-            return false;   // timeout
-        }
-
-        if (USART_SR(USART2) & USART_SR_RXNE) {
-            r = usart_recv(USART2);
-            return r == c;
-        }
-
-    }
+    return r == (uint8_t) c;
 
 }
 
 static bool _get_byte(uint8_t *b, uint64_t timeout) {
 
-    uint64_t until;
+    // also keeps the link metrics: line errors, and throughput measured over
+    // bursts (bytes arriving within MODEM_BURST_GAP_MS of each other) so that
+    // the modem's thinking time doesn't count against the link
+
+    uint64_t until, now;
+    uint32_t sr;
 
     until = millis() + timeout;
 
     while (1) {
 
-        if (millis() >= until) {
+        now = millis();
+        if (now >= until) {
+            if (_cmd_pending) {
+                metrics_add(METRIC_MODEM_AT_TIMEOUTS, 1);
+                _cmd_pending = false;
+            }
             return false;   // timeout
         }
 
-        if (USART_SR(USART2) & USART_SR_RXNE) {
-            *b = usart_recv(USART2);
+        sr = USART_SR(USART2);
+        if (sr & USART_SR_RXNE) {
+
+            if (sr & (USART_SR_FE | USART_SR_NE | USART_SR_ORE)) {
+                metrics_add(METRIC_MODEM_LINE_ERRORS, 1);
+            }
+
+            *b = usart_recv(USART2);    // also clears the error flags
+
+            if (_cmd_pending) {
+                metrics_add(METRIC_MODEM_AT_LATENCY_TOTAL_MS, now - _cmd_sent_ms);
+                if (now - _cmd_sent_ms > metrics_get(METRIC_MODEM_AT_LATENCY_MAX_MS)) {
+                    metrics_set(METRIC_MODEM_AT_LATENCY_MAX_MS, now - _cmd_sent_ms);
+                }
+                _cmd_pending = false;
+            }
+
+            // kept to a couple of additions, this runs for every byte at
+            // up to 921600 baud
+            _rx_bytes++;
+            if ((now - _rx_last_ms) <= MODEM_BURST_GAP_MS) {
+                _rx_burst_bytes++;
+                _rx_burst_ms += now - _rx_last_ms;
+            } else {
+                modem_update_metrics();     // the last burst is over
+            }
+            _rx_last_ms = now;
+
             return true;
+
         }
 
     }
@@ -475,12 +1116,22 @@ static bool _get_variable_length_response(uint64_t timeout) {
 
     // result is stored in MODEM_BUF
 
+    MODEM_BUF_IDX = 0;
+
+    return _get_line(timeout);
+
+}
+
+static bool _get_line(uint64_t timeout) {
+
+    // receive one \r\n framed line and append it to MODEM_BUF at
+    // MODEM_BUF_IDX, null terminated, leaving MODEM_BUF_IDX after the null
+
     uint8_t byte;
 
     if (!_wait_for_char('\r', timeout)) return false;
     if (!_wait_for_char('\n', MODEM_CTO_MS)) return false;
 
-    MODEM_BUF_IDX = 0;
     while (1) {
 
         if (!_get_byte(&byte, MODEM_CTO_MS)) return false;
@@ -522,7 +1173,6 @@ static bool _confirm_response(const char *resp, uint64_t timeout) {
     if (!_wait_for_char('\r', MODEM_CTO_MS)) return false;
     if (!_wait_for_char('\n', MODEM_CTO_MS)) return false;
 
-
     return true;
 
 }
@@ -546,3 +1196,111 @@ static void _flush_rx(void) {
 
 }
 
+static void _set_baudrate(uint32_t baudrate) {
+
+    usart_disable(USART2);
+    usart_set_baudrate(USART2, baudrate);
+    usart_enable(USART2);
+
+    _baudrate = baudrate;
+
+}
+
+static void _set_flow_control(bool enable) {
+
+    // CTS on PA0, RTS on PA1
+    // while flow control is off, RTS is held low (asserted) as a GPIO so that
+    // a modem that still has AT+IFC=2,2 saved will talk to us
+
+    _flow_control = enable;
+
+    if (enable) {
+        gpio_mode_setup(GPIOA, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO0 | GPIO1);
+        gpio_set_af(GPIOA, GPIO_AF7, GPIO0 | GPIO1);
+        usart_set_flow_control(USART2, USART_FLOWCONTROL_RTS_CTS);
+    } else {
+        usart_set_flow_control(USART2, USART_FLOWCONTROL_NONE);
+        gpio_mode_setup(GPIOA, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, GPIO1);
+        gpio_clear(GPIOA, GPIO1);
+    }
+
+}
+
+static bool _apply_setting(const char *cmd, uint8_t value) {
+
+    // query "<cmd>?" and write "<cmd>=<value>" only if it differs
+    // e.g. cmd = "AT+CNMP", response "+CNMP: 38"
+
+    char ATstring[20];
+    size_t n;
+
+    sprintf(ATstring, "%s?", cmd);
+    _send_command(ATstring);
+    if (!_get_variable_length_response(1000)) return false;
+    if (!_confirm_response("OK", 1000)) return false;
+
+    n = strlen(cmd + 2);    // skip "AT"
+    if (!strncmp((const char *) MODEM_BUF, cmd + 2, n) && (MODEM_BUF[n] == ':')
+            && (strtol((const char *) (MODEM_BUF + n + 1), NULL, 10) == value)) {
+        return true;
+    }
+
+    sprintf(ATstring, "%s=%d", cmd, value);
+
+    return _send_confirm(ATstring, "OK", 1000);
+
+}
+
+static bool _http_init(const char *url) {
+
+    char ATstring[MODEM_AT_LEN];
+
+    if (!_send_confirm("AT+HTTPINIT", "OK", 1000)) return false;
+
+    if (!_send_confirm("AT+HTTPPARA=\"CID\",1", "OK", 1000)) goto fail;
+    snprintf(ATstring, sizeof(ATstring), "AT+HTTPPARA=\"URL\",\"%s\"", url);
+    if (!_send_confirm(ATstring, "OK", 1000)) goto fail;
+
+    return true;
+
+fail:
+    _send_confirm("AT+HTTPTERM", "OK", 1000);
+    return false;
+
+}
+
+static int32_t _days_from_civil(int32_t y, uint32_t m, uint32_t d) {
+
+    // days since 1970-01-01 of a proleptic Gregorian date, for years >= 0
+    // (http://howardhinnant.github.io/date_algorithms.html)
+
+    uint32_t yoe, doy, doe;
+    int32_t era;
+
+    y -= (m <= 2);
+    era = y / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + (int32_t) doe - 719468;
+
+}
+
+static bool _link_check(void) {
+
+    // a burst of round trips at the current rate, all of which have to come
+    // back clean
+
+    uint32_t errors;
+
+    errors = metrics_get(METRIC_MODEM_LINE_ERRORS);
+
+    for (int i=0; i<MODEM_LINK_CHECKS; i++) {
+        if (!_send_confirm("AT", "OK", 100)) return false;
+    }
+
+    return metrics_get(METRIC_MODEM_LINE_ERRORS) == errors;
+
+}
+
@@ -0,0 +1,59 @@
+#include <string.h>
+
+#include <libopencm3/stm32/memorymap.h>
+#include <libopencm3/stm32/flash.h>
+
+#include "nvm.h"
+#include "crc.h"
+
+#define NVM_HEADER_SIZE 8
+#define NVM_MAGIC 0x5c100000    // upper half of the first header word
+
+static uint32_t _slot_addr(uint8_t slot) {
+
+    return EEPROM_DATA_BASE + slot * NVM_SLOT_SIZE;
+
+}
+
+bool nvm_load(uint8_t slot, void *data, size_t len) {
+
+    // returns false if the slot is empty, corrupt, or holds a record of a
+    // different size (e.g. written by an older firmware)
+
+    const uint32_t *slot_data = (const uint32_t *) _slot_addr(slot);
+
+    if (len > NVM_SLOT_SIZE - NVM_HEADER_SIZE) return false;
+    if (slot_data[0] != (NVM_MAGIC | len)) return false;
+
+    memcpy(data, slot_data + 2, len);
+
+    return slot_data[1] == crc32(data, len);
+
+}
+
+bool nvm_store(uint8_t slot, const void *data, size_t len) {
+
+    // EEPROM wears, so only the words that differ are programmed
+
+    uint32_t words[NVM_SLOT_SIZE / 4];
+    uint32_t addr;
+    size_t n;
+
+    if (len > NVM_SLOT_SIZE - NVM_HEADER_SIZE) return false;
+
+    memset(words, 0, sizeof(words));
+    words[0] = NVM_MAGIC | len;
+    words[1] = crc32(data, len);
+    memcpy(words + 2, data, len);
+    n = (NVM_HEADER_SIZE + len + 3) / 4;
+
+    addr = _slot_addr(slot);
+    for (size_t i=0; i<n; i++) {
+        if (((volatile uint32_t *) addr)[i] != words[i]) {
+            eeprom_program_word(addr + 4*i, words[i]);
+        }
+    }
+
+    return memcmp((const void *) addr, words, n * 4) == 0;
+
+}
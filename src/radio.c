@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "radio.h"
+
+static const char *const _bucket_names[RADIO_N_BUCKETS] = {
+    [RADIO_MARGINAL] = "marginal",
+    [RADIO_OK] = "ok",
+    [RADIO_GOOD] = "good",
+    [RADIO_EXCELLENT] = "excellent",
+};
+
+// the history is kept here unless radio_setup() says otherwise
+static struct radio_history _default;
+static struct radio_history *_h = &_default;
+
+// uploads by the signal they were attempted at
+static struct {
+    uint32_t uploads;
+    uint32_t failures;
+    uint32_t bytes;     // sent by the ones that succeeded
+    uint32_t ms;        // spent on all of them
+} _buckets[RADIO_N_BUCKETS];
+
+static uint8_t _latest(size_t, const uint8_t*);
+
+void radio_setup(struct radio_history *history) {
+
+    // keep the history in history from now on, e.g. one per virtual device
+    // in tools/loadgen
+
+    _h = history;
+
+}
+
+void radio_record(uint8_t rssi, uint8_t ber) {
+
+    // call with every AT+CSQ reading
+
+    _h->rssi[_h->head] = rssi;
+    _h->ber[_h->head] = ber;
+    _h->head = (_h->head + 1) % RADIO_HISTORY;
+    if (_h->count < RADIO_HISTORY) _h->count++;
+
+}
+
+bool radio_link_good(uint32_t min_rssi, uint32_t max_ber) {
+
+    // True if the last RADIO_STABLE readings all had at least min_rssi and
+    // at most max_ber, so that one lucky reading doesn't count. The modem
+    // only knows the BER during a transfer, so an unknown one passes.
+
+    size_t i;
+
+    if (!min_rssi) return true;
+    if (_h->count < RADIO_STABLE) return false;
+
+    for (i=0; i<RADIO_STABLE; i++) {
+        if ((_latest(i, _h->rssi) == RADIO_UNKNOWN) || (_latest(i, _h->rssi) < min_rssi)) return false;
+        if ((_latest(i, _h->ber) != RADIO_UNKNOWN) && (_latest(i, _h->ber) > max_ber)) return false;
+    }
+
+    return true;
+
+}
+
+radio_bucket_t radio_bucket(void) {
+
+    uint8_t rssi;
+
+    if (!_h->count) return RADIO_MARGINAL;
+
+    rssi = _latest(0, _h->rssi);
+    if ((rssi == RADIO_UNKNOWN) || (rssi < 10)) return RADIO_MARGINAL;
+    if (rssi < 15) return RADIO_OK;
+    if (rssi < 20) return RADIO_GOOD;
+    return RADIO_EXCELLENT;
+
+}
+
+void radio_account(uint32_t bytes, uint32_t ms, bool ok) {
+
+    // an upload attempt of bytes that took ms, at the current signal
+
+    radio_bucket_t b = radio_bucket();
+
+    _buckets[b].uploads++;
+    _buckets[b].ms += ms;
+    if (ok) {
+        _buckets[b].bytes += bytes;
+    } else {
+        _buckets[b].failures++;
+    }
+
+}
+
+void radio_print(void) {
+
+    // the energy is only an estimate, RADIO_ACTIVE_MW for as long as posting
+    // took, failures included since they cost as much
+
+    size_t i;
+
+    printf("rssi/ber, newest first:");
+    for (i=0; i<_h->count; i++) {
+        printf(" %u/%u", _latest(i, _h->rssi), _latest(i, _h->ber));
+    }
+    printf("\n");
+
+    for (i=0; i<RADIO_N_BUCKETS; i++) {
+        printf("%-9s %lu uploads, %lu failed, %lu B in %lu ms",
+                _bucket_names[i], (unsigned long) _buckets[i].uploads,
+                (unsigned long) _buckets[i].failures, (unsigned long) _buckets[i].bytes,
+                (unsigned long) _buckets[i].ms);
+        if (_buckets[i].bytes) {
+            printf(", %.2f ms/B, %.1f uJ/B",
+                    (float) _buckets[i].ms / _buckets[i].bytes,
+                    (float) _buckets[i].ms * RADIO_ACTIVE_MW / _buckets[i].bytes);
+        }
+        printf("\n");
+    }
+
+}
+
+static uint8_t _latest(size_t i, const uint8_t *history) {
+
+    // i = 0 is the newest
+
+    return history[(_h->head + RADIO_HISTORY - 1 - i) % RADIO_HISTORY];
+
+}
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "samples.h"
+
+// the storage is passed in, so that it can survive a warm restart
+static struct samples_queue *_q;
+
+// the JSON key of each channel
+static const char *const _default_keys[SAMPLES_CHANNELS] = {
+    "temperature", "temperature_1", "temperature_2", "temperature_3",
+};
+static const char *const *_keys = _default_keys;
+
+// turns a sample's ts into UTC ms since the epoch, 0 if it can't yet; with
+// none, ts is UTC already (or 0 if unknown)
+static uint64_t (*_utc)(uint64_t) = NULL;
+
+void samples_setup(struct samples_queue *q) {
+
+    _q = q;
+
+}
+
+void samples_set_keys(const char *const *keys) {
+
+    // keys has SAMPLES_CHANNELS entries, one per channel; see sensors_keys()
+
+    _keys = keys;
+
+}
+
+void samples_set_clock(uint64_t (*utc)(uint64_t)) {
+
+    // samples are stamped with a local clock and converted when they're
+    // formatted, so ones taken before the clock was synced still get a UTC
+    // timestamp if they're sent after; see timesync_utc()
+
+    _utc = utc;
+
+}
+
+void samples_push(const struct sample *sample) {
+
+    // when full, the oldest sample makes way
+
+    if (_q->count == SAMPLES_MAX) {
+        _q->head = (_q->head + 1) % SAMPLES_MAX;
+        _q->count--;
+    }
+
+    _q->buf[(_q->head + _q->count) % SAMPLES_MAX] = *sample;
+    _q->count++;
+
+}
+
+size_t samples_count(void) {
+
+    return _q->count;
+
+}
+
+const struct sample *samples_peek(size_t i) {
+
+    // i = 0 is the oldest
+
+    if (i >= _q->count) return NULL;
+
+    return &_q->buf[(_q->head + i) % SAMPLES_MAX];
+
+}
+
+void samples_drop(size_t n) {
+
+    // drop the n oldest, e.g. once they've been uploaded
+
+    if (n > _q->count) n = _q->count;
+
+    _q->head = (_q->head + n) % SAMPLES_MAX;
+    _q->count -= n;
+
+}
+
+static int _format_values(char *buf, size_t size, const struct sample *s) {
+
+    // the channels as JSON members, e.g. "temperature":21.250, skipping any
+    // that couldn't be read
+
+    size_t len = 0, c;
+    int r;
+
+    for (c=0; c<s->channels; c++) {
+        if (isnan(s->values[c])) continue;
+        r = snprintf(buf + len, size - len, "%s\"%s\":%.3f",
+                len ? "," : "", _keys[c], s->values[c]);
+        if ((r < 0) || ((size_t) r >= size - len)) return -1;
+        len += r;
+    }
+
+    return len;
+
+}
+
+size_t samples_format_json(char *buf, size_t size, size_t n) {
+
+    // write up to n of the oldest samples to buf as a JSON array, e.g.
+    //   [{"ts":1700000000000,"values":{"temperature":21.250}},
+    //    {"temperature":21.312,"temperature_1":20.875}]
+    // where samples with no UTC time yet are left for the server to stamp.
+    // Returns how many made it in before buf ran out of room
+
+    char values[SAMPLES_CHANNELS * 32];
+    const struct sample *s;
+    uint64_t ts;
+    size_t len, i;
+    int r;
+
+    if (size < 3) return 0;
+
+    len = 0;
+    buf[len++] = '[';
+
+    for (i=0; (i < n) && (i < _q->count); i++) {
+
+        s = samples_peek(i);
+        if (_format_values(values, sizeof(values), s) < 0) values[0] = '\0';
+        ts = _utc ? _utc(s->ts) : s->ts;
+        if (ts) {
+            r = snprintf(buf + len, size - len,
+                    "%s{\"ts\":%lu%03u,\"values\":{%s}}",
+                    i ? "," : "", (unsigned long) (ts / 1000),
+                    (unsigned) (ts % 1000), values);
+        } else {
+            r = snprintf(buf + len, size - len, "%s{%s}", i ? "," : "", values);
+        }
+
+        if ((r < 0) || ((size_t) r >= size - len - 1)) break;   // -1 for ']'
+        len += r;
+
+    }
+
+    buf[len++] = ']';
+    buf[len] = '\0';
+
+    return i;
+
+}
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <math.h>
+#include <string.h>
+
+#include "i2cbus.h"
+#include "samples.h"
+#include "sensors.h"
+#include "metrics.h"
+#include "mcp9808.h"
+#include "tmp102.h"
+
+#define SCAN_BATCH 16   // probes per i2cbus_run()
+
+// every driver gets a look at each address in its range that answers
+static const struct sensor_driver *const _drivers[] = {
+    &mcp9808_driver,
+    &tmp102_driver,
+};
+#define N_DRIVERS (sizeof(_drivers) / sizeof(_drivers[0]))
+
+static struct sensor _sensors[SENSORS_MAX];
+static const char *_keys[SENSORS_MAX];
+static size_t _n = 0;
+
+// shared by the scan and the reads
+static struct i2c_xfer _xfers[(SCAN_BATCH > SENSORS_MAX) ? SCAN_BATCH : SENSORS_MAX];
+
+static void _add(const struct sensor_driver*, uint8_t);
+
+size_t sensors_scan(void) {
+
+    // Probes every address, and keeps whatever a driver recognises; anything
+    // else is only reported. Returns how many sensors there are.
+
+    const struct sensor_driver *d;
+    uint8_t first, addr;
+    size_t i, j, k;
+
+    _n = 0;
+
+    for (first = SENSORS_SCAN_FIRST; first <= SENSORS_SCAN_LAST; first += SCAN_BATCH) {
+
+        k = 0;
+        for (addr = first; (addr <= SENSORS_SCAN_LAST) && (k < SCAN_BATCH); addr++) {
+            memset(&_xfers[k], 0, sizeof(_xfers[k]));
+            _xfers[k++].addr = addr;
+        }
+        i2cbus_run(_xfers, k);
+
+        for (i=0; i<k; i++) {
+
+            if (_xfers[i].status != I2C_OK) continue;
+            addr = _xfers[i].addr;
+
+            for (j=0; j<N_DRIVERS; j++) {
+                d = _drivers[j];
+                if ((addr >= d->addr_first) && (addr <= d->addr_last) && d->identify(addr)) break;
+            }
+
+            if (j == N_DRIVERS) {
+                printf("[STATUS] i2c 0x%02x: unknown device\n", addr);
+            } else if (_n == SENSORS_MAX) {
+                printf("[ERROR] i2c 0x%02x: %s ignored, too many sensors\n", addr, d->name);
+            } else {
+                _add(d, addr);
+                printf("[STATUS] i2c 0x%02x: %s (%s)\n", addr, d->name, _sensors[_n - 1].key);
+            }
+
+        }
+
+    }
+
+    metrics_set(METRIC_SENSORS, _n);
+
+    return _n;
+
+}
+
+size_t sensors_count(void) {
+
+    return _n;
+
+}
+
+const struct sensor *sensors_get(size_t i) {
+
+    if (i >= _n) return NULL;
+
+    return &_sensors[i];
+
+}
+
+const char *const *sensors_keys(void) {
+
+    // the JSON key of each channel, for samples_set_keys()
+
+    return _keys;
+
+}
+
+size_t sensors_read(float *values) {
+
+    // Reads every sensor in one go into values, NAN for any that failed.
+    // Returns how many channels there are.
+
+    struct sensor *s;
+    uint32_t total = 0;
+    size_t i;
+
+    for (i=0; i<_n; i++) {
+        memset(&_xfers[i], 0, sizeof(_xfers[i]));
+        _xfers[i].addr = _sensors[i].addr;
+        _xfers[i].wlen = 1;
+        _xfers[i].rlen = 2;
+        _xfers[i].wbuf[0] = _sensors[i].driver->reg;
+    }
+
+    i2cbus_run(_xfers, _n);
+
+    for (i=0; i<_n; i++) {
+
+        s = &_sensors[i];
+        s->reads++;
+        s->latency_us = i2cbus_cycles_to_us(_xfers[i].cycles);
+        if (s->latency_us > s->latency_max_us) s->latency_max_us = s->latency_us;
+        total += s->latency_us;
+
+        if (_xfers[i].status == I2C_OK) {
+            s->value = s->driver->convert(_xfers[i].rbuf);
+        } else {
+            s->value = NAN;
+            s->errors++;
+            if (_xfers[i].status == I2C_TIMEOUT) s->timeouts++;
+            metrics_add(METRIC_SENSOR_ERRORS, 1);
+        }
+        values[i] = s->value;
+
+    }
+
+    metrics_set(METRIC_SENSOR_READ_US, total);
+
+    return _n;
+
+}
+
+static void _add(const struct sensor_driver *d, uint8_t addr) {
+
+    // the first of each quantity keeps the plain key, e.g. "temperature", so
+    // a single sensor device posts what it always has
+
+    struct sensor *s = &_sensors[_n];
+    size_t i, same = 0;
+
+    for (i=0; i<_n; i++) {
+        if (!strcmp(_sensors[i].driver->quantity, d->quantity)) same++;
+    }
+
+    memset(s, 0, sizeof(*s));
+    s->driver = d;
+    s->addr = addr;
+    s->value = NAN;
+    if (same) {
+        snprintf(s->key, sizeof(s->key), "%s_%u", d->quantity, (unsigned) same);
+    } else {
+        snprintf(s->key, sizeof(s->key), "%s", d->quantity);
+    }
+    _keys[_n++] = s->key;
+
+}
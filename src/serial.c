@@ -4,10 +4,18 @@
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/usart.h>
+#include <libopencm3/cm3/nvic.h>
 
 #include "serial.h"
+#include "metrics.h"
 
 extern int _write(int, const char *, ssize_t);
+extern void usart3_isr(void);
+
+// RX ring buffer, filled by usart3_isr()
+static volatile uint8_t _rx_buf[SERIAL_RX_BUF_SIZE];
+static volatile size_t _rx_head = 0;    // written by the ISR
+static volatile size_t _rx_tail = 0;    // read by serial_getc()
 
 void serial_setup(void) {
 
@@ -19,13 +27,77 @@ void serial_setup(void) {
     gpio_mode_setup(GPIOC, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO10 | GPIO11);
     gpio_set_af(GPIOC, GPIO_AF7, GPIO10 | GPIO11);
 
-    usart_set_baudrate(USART3, 115200);
+    usart_set_baudrate(USART3, SERIAL_BAUD);
     usart_set_databits(USART3, 8);
     usart_set_parity(USART3, USART_PARITY_NONE);
     usart_set_stopbits(USART3, USART_CR2_STOPBITS_1);
     usart_set_flow_control(USART3, USART_FLOWCONTROL_NONE);
     usart_set_mode(USART3, USART_MODE_TX_RX);  // duplex
 
+    usart_enable_rx_interrupt(USART3);
+    nvic_enable_irq(NVIC_USART3_IRQ);
+
+    usart_enable(USART3);
+
+}
+
+void usart3_isr(void) {
+
+    size_t next, depth;
+
+    if (USART_SR(USART3) & USART_SR_RXNE) {
+
+        next = (_rx_head + 1) % SERIAL_RX_BUF_SIZE;
+
+        if (next == _rx_tail) {
+            usart_recv(USART3);     // full, drop it
+            metrics_add(METRIC_SERIAL_RX_OVERFLOWS, 1);
+            return;
+        }
+
+        _rx_buf[_rx_head] = usart_recv(USART3);
+        _rx_head = next;
+
+        depth = serial_rx_depth();
+        if (depth > metrics_get(METRIC_SERIAL_RX_MAX_DEPTH)) {
+            metrics_set(METRIC_SERIAL_RX_MAX_DEPTH, depth);
+        }
+
+    }
+
+}
+
+bool serial_getc(char *c) {
+
+    // non-blocking, returns false if nothing has been received
+
+    if (_rx_tail == _rx_head) return false;
+
+    *c = _rx_buf[_rx_tail];
+    _rx_tail = (_rx_tail + 1) % SERIAL_RX_BUF_SIZE;
+
+    return true;
+
+}
+
+size_t serial_rx_depth(void) {
+
+    return (_rx_head + SERIAL_RX_BUF_SIZE - _rx_tail) % SERIAL_RX_BUF_SIZE;
+
+}
+
+void serial_flush(void) {
+
+    // wait for the last byte to leave the shift register
+
+    while (!(USART_SR(USART3) & USART_SR_TC));
+
+}
+
+void serial_clock_changed(void) {
+
+    usart_disable(USART3);
+    usart_set_baudrate(USART3, SERIAL_BAUD);
     usart_enable(USART3);
 
 }
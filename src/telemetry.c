@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "telemetry.h"
+#include "modem.h"
+#include "millis.h"
+#include "metrics.h"
+#include "config.h"
+#include "samples.h"
+#include "radio.h"
+#include "mem.h"
+
+static bool _post(void);
+static bool _https_connect(void);
+
+static char payload[SAMPLES_PAYLOAD_SIZE];
+static char url[CONFIG_URL_SIZE];
+
+#ifdef TLS_CA_PEM_FILE
+#define TLS_CA_NAME "ca.pem"
+static const char ca_pem[] =
+#include TLS_CA_PEM_FILE
+;
+#endif
+
+bool telemetry_connect(void) {
+
+    // the data connection for the transport config->tls asks for: the
+    // AT+SAPBR bearer for HTTP, the app network (AT+CNACT) for HTTPS
+
+    struct config *config = config_get();
+
+    if (config->tls == CONFIG_TLS_OFF) {
+        modem_https_disconnect();
+        return modem_connect_bearer(config->apn, config->apn_user, config->apn_pwd);
+    }
+
+    return modem_connect_app_network(config->apn);
+
+}
+
+size_t telemetry_post(void) {
+
+    // post the oldest queued samples; returns how many went, 0 if the post
+    // failed, see uplink_posted()
+
+    uint64_t start = millis();
+    uint32_t latency;
+    size_t n, len;
+    bool ok;
+
+    n = samples_format_json(payload, sizeof(payload), SAMPLES_MAX_BATCH);
+    len = strlen(payload);
+    ok = _post();
+
+    latency = millis() - start;
+    radio_account(len, latency, ok);
+    if (!ok) return 0;
+
+    metrics_add(METRIC_UPLOADS, 1);
+    metrics_add(METRIC_UPLOAD_LATENCY_TOTAL_MS, latency);
+    if (latency > metrics_get(METRIC_UPLOAD_LATENCY_MAX_MS)) {
+        metrics_set(METRIC_UPLOAD_LATENCY_MAX_MS, latency);
+    }
+
+    printf("POST succeeded (%u samples, %lu ms)\n", (unsigned) n, (unsigned long) latency);
+
+    return n;
+
+}
+
+bool telemetry_post_health(void) {
+
+    // RAM use, as telemetry of its own: the heap now and at its peak, the
+    // stack's high-water mark, and the headroom left between them
+
+    struct mem_usage mem;
+
+    mem_get_usage(&mem);
+    snprintf(payload, sizeof(payload),
+            "{\"mem_heap\":%lu,\"mem_heap_max\":%lu,\"mem_stack_max\":%lu,\"mem_free\":%lu}",
+            (unsigned long) mem.heap, (unsigned long) mem.heap_max,
+            (unsigned long) mem.stack_max, (unsigned long) mem.free);
+
+    return _post();
+
+}
+
+bool telemetry_fetch_config(void) {
+
+    // fetch the shared attributes and apply them, see config_apply_json()
+
+    struct config *config = config_get();
+    bool ok;
+
+    if (config->tls == CONFIG_TLS_OFF) {
+        config_attributes_url(url, sizeof(url));
+        ok = modem_http_get(url);
+    } else {
+        config_attributes_path(url, sizeof(url));
+        ok = (modem_https_connected() || _https_connect())
+             && modem_https_get(url);
+        if (config->tls == CONFIG_TLS_PER_POST) modem_https_disconnect();
+    }
+    if (!ok) return false;
+
+    if (config_apply_json(modem_get_buffer_string())) {
+        printf("[STATUS] new config: %s\n", modem_get_buffer_string());
+    }
+
+    return true;
+
+}
+
+static bool _post(void) {
+
+    // payload to the telemetry endpoint
+
+    struct config *config = config_get();
+    bool ok;
+
+    if (config->tls == CONFIG_TLS_OFF) {
+        config_telemetry_url(url, sizeof(url));
+        return modem_http_post(url, payload);
+    }
+
+    config_telemetry_path(url, sizeof(url));
+    ok = (modem_https_connected() || _https_connect())
+         && modem_https_post(url, payload);
+    if (config->tls == CONFIG_TLS_PER_POST) modem_https_disconnect();
+
+    return ok;
+
+}
+
+static bool _https_connect(void) {
+
+    // the CA certificate, if the build has one, is loaded into the modem on
+    // first use, see the Makefile
+
+    struct config *config = config_get();
+
+#ifdef TLS_CA_PEM_FILE
+    static bool ca_loaded = false;
+
+    if (!ca_loaded) {
+        if (!modem_tls_load_ca(TLS_CA_NAME, ca_pem)) {
+            printf("[ERROR] modem_tls_load_ca failed\n");
+            return false;
+        }
+        ca_loaded = true;
+    }
+    if (!modem_https_connect(config->host, TLS_CA_NAME)) return false;
+#else
+    if (!modem_https_connect(config->host, "")) return false;
+#endif
+
+    printf("HTTPS connection established\n");
+
+    return true;
+
+}
@@ -0,0 +1,147 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "watchdog.h"
+#include "samples.h"
+#include "timesync.h"
+#include "warm.h"
+#include "modem.h"
+#include "metrics.h"
+
+// the storage is passed in, so that the mapping survives a warm restart
+// along with the samples stamped against it
+static struct timesync *_t;
+
+static int64_t _slewed(int64_t);
+static uint64_t _predict(uint64_t);
+
+void timesync_setup(struct timesync *t, bool restarted) {
+
+    // across a warm restart the local clock misses the time the reset took,
+    // so a drift measurement is started over rather than spanning it
+
+    _t = t;
+
+    if (restarted) _t->window_utc = 0;
+
+}
+
+bool timesync_sync(void) {
+
+    // The modem's clock is set by the network (AT+CLTS=1) when it registers;
+    // if it hasn't been, we fall back to asking it to use NTP.
+
+    uint64_t network, local, predicted;
+    int64_t elapsed_network, elapsed_local, drift, error;
+
+    if (!modem_get_network_time(&network)) {
+        if (!modem_ntp_sync(TIMESYNC_NTP_SERVER)) return false;
+        if (!modem_get_network_time(&network)) return false;
+    }
+    local = warm_clock();
+
+    if (!_t->synced) {
+
+        _t->utc = network;
+        _t->local = local;
+        _t->slew_ms = 0;
+
+    } else {
+
+        // the mapping carries on from where it has got to, with the error
+        // worked in from here on; only one too big to wait for is stepped
+        predicted = _predict(local);
+        error = network - predicted;
+        metrics_set(METRIC_TIME_CORRECTION_MS, (error < 0) ? -error : error);
+
+        if ((error > TIMESYNC_STEP_MS) || (error < -TIMESYNC_STEP_MS)) {
+            _t->utc = network;
+            _t->slew_ms = 0;
+        } else {
+            _t->utc = predicted;
+            _t->slew_ms = error;
+        }
+        _t->local = local;
+
+    }
+
+    elapsed_local = local - _t->window_local;
+    if (!_t->window_utc || (elapsed_local >= TIMESYNC_DRIFT_WINDOW_MS)) {
+        if (_t->window_utc) {
+            elapsed_network = network - _t->window_utc;
+            drift = (elapsed_network - elapsed_local) * 1000000 / elapsed_local;
+            if ((drift < TIMESYNC_MAX_DRIFT_PPM) && (drift > -TIMESYNC_MAX_DRIFT_PPM)) {
+                _t->drift_ppm = drift;
+            }
+        }
+        _t->window_utc = network;
+        _t->window_local = local;
+    }
+
+    _t->synced = true;
+    metrics_add(METRIC_TIME_SYNCS, 1);
+
+    return true;
+
+}
+
+bool timesync_valid(void) {
+
+    return _t->synced;
+
+}
+
+uint64_t timesync_utc(uint64_t local) {
+
+    // UTC in ms since the epoch at local, a warm_clock() time, or 0 if we
+    // haven't synced yet. Works as well for times before the last sync.
+
+    if (!_t->synced) return 0;
+
+    return _predict(local);
+
+}
+
+uint64_t timesync_now_ms(void) {
+
+    return timesync_utc(warm_clock());
+
+}
+
+int32_t timesync_drift_ppm(void) {
+
+    return _t->drift_ppm;
+
+}
+
+int32_t timesync_slew_ms(void) {
+
+    // what's left of the last sync's error to work in
+
+    return _t->slew_ms - _slewed(warm_clock() - _t->local);
+
+}
+
+static int64_t _slewed(int64_t elapsed) {
+
+    // how much of the slew is in, elapsed ms after the anchor
+
+    int64_t done = (elapsed > 0) ? elapsed * TIMESYNC_SLEW_PPM / 1000000 : 0;
+
+    if (_t->slew_ms < 0) return (done >= -_t->slew_ms) ? _t->slew_ms : -done;
+
+    return (done >= _t->slew_ms) ? _t->slew_ms : done;
+
+}
+
+static uint64_t _predict(uint64_t local) {
+
+    // the mapping at local: the drift applies on either side of the anchor,
+    // the slew only after it
+
+    int64_t elapsed = local - _t->local;
+
+    return _t->utc + elapsed + elapsed * _t->drift_ppm / 1000000 + _slewed(elapsed);
+
+}
@@ -0,0 +1,44 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "i2cbus.h"
+#include "samples.h"
+#include "sensors.h"
+#include "tmp102.h"
+
+static bool _identify(uint8_t);
+static float _convert(const uint8_t*);
+
+const struct sensor_driver tmp102_driver = {
+    .name = "TMP102",
+    .quantity = "temperature",
+    .addr_first = TMP102_ADDR7,
+    .addr_last = TMP102_ADDR7 + 3,
+    .reg = TMP102_REG_TEMP,
+    .identify = _identify,
+    .convert = _convert,
+};
+
+static bool _identify(uint8_t addr) {
+
+    // there's no ID register, but the resolution bits of the configuration
+    // always read 11 and the low nibble 0
+
+    struct i2c_xfer xfer = {.addr = addr, .wlen = 1, .rlen = 2, .wbuf = {TMP102_REG_CONFIG}};
+
+    if (!i2cbus_run(&xfer, 1)) return false;
+
+    return ((xfer.rbuf[0] & 0x60) == 0x60) && !(xfer.rbuf[1] & 0x0f);
+
+}
+
+static float _convert(const uint8_t *raw) {
+
+    // 12 bits left justified, or 13 in extended mode (bit 0), in 1/16 C
+
+    int16_t t = (int16_t) ((raw[0] << 8) | raw[1]);
+
+    return (raw[1] & 0x01) ? (t >> 3) / 16.f : (t >> 4) / 16.f;
+
+}
@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "config.h"
+#include "samples.h"
+#include "metrics.h"
+#include "uplink.h"
+
+static void _caught_up(struct uplink*, const struct config*, uint64_t);
+
+void uplink_setup(struct uplink *u, bool connected) {
+
+    // the first upload is due straight away
+
+    u->due = false;
+    u->urgent = false;
+    u->deferred = false;
+    u->connected = connected;
+    u->draining = false;
+    u->due_since = 0;
+    u->next = 0;
+    u->reference = NAN;
+
+}
+
+void uplink_request(struct uplink *u) {
+
+    // an upload that goes as soon as it can, e.g. from the console
+
+    u->due = true;
+    u->urgent = true;
+
+}
+
+void uplink_sampled(struct uplink *u, const struct config *config, const struct sample *s) {
+
+    // call with every new sample; a first channel reading that has moved
+    // report_threshold from the last one uploaded is urgent. The first
+    // reading after boot is the reference, not a crossing.
+
+    if (!s->channels || isnan(s->values[0])) return;
+
+    if (isnan(u->reference)) {
+        u->reference = s->values[0];
+    } else if ((config->report_threshold > 0)
+            && (fabsf(s->values[0] - u->reference) >= config->report_threshold)) {
+        uplink_request(u);
+    }
+
+}
+
+bool uplink_ready(struct uplink *u, const struct config *config, uint64_t now, bool link_good) {
+
+    // Whether to post now. A routine upload (upload_interval or batch_size)
+    // waits for a good enough signal, link_good, where it's quicker and
+    // cheaper, unless it's waited upload_max_delay_ms already or the queue
+    // is about to drop samples. Anything urgent goes regardless.
+
+    bool send;
+
+    if ((now >= u->next) || (samples_count() >= config->batch_size)) u->due = true;
+    if (!u->due) return false;
+
+    if (!samples_count()) {
+        _caught_up(u, config, now);
+        return false;
+    }
+
+    if (!u->due_since) u->due_since = now;
+    send = u->urgent || link_good
+           || (now - u->due_since >= config->upload_max_delay_ms)
+           || (samples_count() >= SAMPLES_MAX - 1);
+    if (!send && !u->deferred) metrics_add(METRIC_UPLOADS_DEFERRED, 1);
+    u->deferred = !send;
+
+    return send;
+
+}
+
+void uplink_posted(struct uplink *u, const struct config *config, uint64_t now, size_t n) {
+
+    // After a post of the n oldest samples, 0 if it failed. A failure drops
+    // the connection, to be brought up again before the next post. Those
+    // that went through are dropped from the queue, and the newest first
+    // channel reading among them is the threshold's new reference.
+
+    const struct sample *s;
+
+    if (!n) {
+        u->connected = false;
+        return;
+    }
+
+    for (size_t i=n; i>0; i--) {
+        s = samples_peek(i - 1);
+        if (s && s->channels && !isnan(s->values[0])) {
+            u->reference = s->values[0];
+            break;
+        }
+    }
+    samples_drop(n);
+
+    u->draining = samples_count() > 0;
+    if (u->draining) {
+        u->next = now;
+    } else {
+        _caught_up(u, config, now);
+    }
+
+}
+
+uint64_t uplink_wake(struct uplink *u, uint64_t next_sample) {
+
+    // when to come back, given the next sample is due at next_sample: an
+    // upload that couldn't happen is retried with the next sample, but a
+    // backlog that's going through is sent straight away
+
+    if (u->due && !u->draining) u->next = next_sample;
+    u->draining = false;
+
+    return (u->next < next_sample) ? u->next : next_sample;
+
+}
+
+static void _caught_up(struct uplink *u, const struct config *config, uint64_t now) {
+
+    u->due = false;
+    u->urgent = false;
+    u->deferred = false;
+    u->due_since = 0;
+    u->next = now + config->upload_interval_ms;
+
+}
@@ -0,0 +1,76 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "watchdog.h"
+#include "samples.h"
+#include "timesync.h"
+#include "warm.h"
+#include "millis.h"
+#include "crc.h"
+
+// from the Makefile, see WARM_SIZE
+extern uint32_t _noinit;
+
+static struct warm *const _warm = (struct warm *) &_noinit;
+
+// where warm_clock() picked up from at the restart
+static uint64_t _clock_base = 0;
+
+_Static_assert(sizeof(struct warm) <= WARM_SIZE, "struct warm overflows into the stack");
+
+static uint32_t _crc(void) {
+
+    return crc32((const uint8_t *) _warm + offsetof(struct warm, resets),
+                 sizeof(struct warm) - offsetof(struct warm, resets));
+
+}
+
+bool warm_setup(reset_cause_t cause) {
+
+    // returns true if the previous state survived, otherwise it's cleared.
+    // Either way the reset is counted.
+
+    bool valid;
+
+    valid = (cause != RESET_POWER_ON) && (_warm->magic == WARM_MAGIC)
+            && (_warm->crc == _crc());
+
+    if (!valid) {
+        memset(_warm, 0, sizeof(*_warm));
+        _warm->magic = WARM_MAGIC;
+    }
+    _clock_base = _warm->clock_ms;
+
+    _warm->resets[cause]++;
+    warm_commit();
+
+    return valid;
+
+}
+
+struct warm *warm_get(void) {
+
+    return _warm;
+
+}
+
+void warm_commit(void) {
+
+    // call after every change, a reset can come at any time
+
+    _warm->clock_ms = warm_clock();
+    _warm->crc = _crc();
+
+}
+
+uint64_t warm_clock(void) {
+
+    // ms like millis(), but carrying on across warm restarts (short of the
+    // time between the last commit and the reset), for stamping what's kept
+    // in here
+
+    return _clock_base + millis();
+
+}
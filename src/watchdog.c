@@ -0,0 +1,104 @@
+#include <stdio.h>
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/iwdg.h>
+
+#include "watchdog.h"
+#include "millis.h"
+
+static reset_cause_t _cause;
+static uint64_t _last[WATCHDOG_N_TASKS];
+static uint32_t _deadline[WATCHDOG_N_TASKS] = {
+    [WATCHDOG_TASK_MAIN] = WATCHDOG_MAIN_DEADLINE_MS,
+    [WATCHDOG_TASK_MODEM] = 0,  // none until set by the main loop
+};
+static bool _missed = false;
+
+static const char *_task_names[WATCHDOG_N_TASKS] = {
+    [WATCHDOG_TASK_MAIN] = "main",
+    [WATCHDOG_TASK_MODEM] = "modem",
+};
+
+static const char *_cause_names[RESET_N_CAUSES] = {
+    [RESET_POWER_ON] = "power on",
+    [RESET_PIN] = "reset pin",
+    [RESET_SOFTWARE] = "software",
+    [RESET_WATCHDOG] = "watchdog",
+    [RESET_LOW_POWER] = "low power",
+};
+
+void watchdog_setup(void) {
+
+    // find out why we reset, clear the flags for next time, and start the
+    // IWDG, which can't be stopped again
+
+    uint32_t csr = RCC_CSR;
+
+    if (csr & (RCC_CSR_IWDGRSTF | RCC_CSR_WWDGRSTF)) {
+        _cause = RESET_WATCHDOG;
+    } else if (csr & RCC_CSR_LPWRRSTF) {
+        _cause = RESET_LOW_POWER;
+    } else if (csr & RCC_CSR_SFTRSTF) {
+        _cause = RESET_SOFTWARE;
+    } else if (csr & RCC_CSR_PORRSTF) {
+        _cause = RESET_POWER_ON;
+    } else if (csr & RCC_CSR_PINRSTF) {     // also set by all of the above
+        _cause = RESET_PIN;
+    } else {
+        _cause = RESET_POWER_ON;
+    }
+    RCC_CSR |= RCC_CSR_RMVF;
+
+    iwdg_set_period_ms(WATCHDOG_PERIOD_MS);
+    iwdg_start();
+
+}
+
+void watchdog_set_deadline(watchdog_task_t task, uint32_t deadline_ms) {
+
+    // 0 means the task isn't supervised. Cheap to call repeatedly: the task
+    // only gets a fresh start when supervision turns on, changing an existing
+    // deadline doesn't count as a check-in.
+
+    if (!_deadline[task]) _last[task] = millis();
+    _deadline[task] = deadline_ms;
+
+}
+
+void watchdog_checkin(watchdog_task_t task) {
+
+    _last[task] = millis();
+
+}
+
+void watchdog_service(void) {
+
+    // cheap, call it as often as you like
+
+    uint64_t now = millis();
+
+    for (int i=0; i<WATCHDOG_N_TASKS; i++) {
+        if (_deadline[i] && ((now - _last[i]) > _deadline[i])) {
+            if (!_missed) {
+                printf("[ERROR] watchdog: %s task missed its deadline\n", _task_names[i]);
+                _missed = true;
+            }
+            return;     // and let the IWDG run out
+        }
+    }
+
+    iwdg_reset();
+
+}
+
+reset_cause_t watchdog_reset_cause(void) {
+
+    return _cause;
+
+}
+
+const char *watchdog_reset_cause_str(reset_cause_t cause) {
+
+    return _cause_names[cause];
+
+}
@@ -0,0 +1,42 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+
+#include "nvm.h"
+#include "watchdog.h"
+#include "mem.h"
+
+// the rest of the hardware modem.c and config.c touch, doing nothing
+
+uint32_t rcc_apb1_frequency = 16000000;
+
+void rcc_periph_clock_enable(int periph) { (void) periph; }
+
+void gpio_mode_setup(uint32_t port, uint8_t mode, uint8_t pupd, uint16_t pins) {
+    (void) port; (void) mode; (void) pupd; (void) pins;
+}
+void gpio_set_af(uint32_t port, uint8_t af, uint16_t pins) { (void) port; (void) af; (void) pins; }
+void gpio_set(uint32_t port, uint16_t pins) { (void) port; (void) pins; }
+void gpio_clear(uint32_t port, uint16_t pins) { (void) port; (void) pins; }
+
+// nothing saved, so everything starts from its defaults
+bool nvm_load(uint8_t slot, void *data, size_t len) { (void) slot; (void) data; (void) len; return false; }
+bool nvm_store(uint8_t slot, const void *data, size_t len) { (void) slot; (void) data; (void) len; return true; }
+
+void watchdog_service(void) {}
+
+// mem.c needs the linker script, so RAM use is made up
+void mem_get_usage(struct mem_usage *usage) {
+
+    usage->data = 512;
+    usage->bss = 8192;
+    usage->heap = 1024;
+    usage->heap_max = 1536;
+    usage->stack_max = 2048;
+    usage->stack_size = 22784;
+    usage->free = 20736;
+
+}
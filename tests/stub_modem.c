@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <libopencm3/stm32/usart.h>
+
+#include "millis.h"
+#include "stub_modem.h"
+
+#define STUB_LINE_SIZE 1024
+#define STUB_LOG_SIZE 32768
+
+static const struct stub_at *_transcript;
+static uint64_t _now = 0;
+
+static char _line[STUB_LINE_SIZE];  // the command coming in
+static size_t _line_len = 0;
+static const char *_rx = NULL;      // the response going out
+
+// every command since stub_modem_setup(), one per line
+static char _log[STUB_LOG_SIZE];
+static size_t _log_len = 0;
+static const char *_last = "";
+
+static void _respond(void);
+
+void stub_modem_setup(const struct stub_at *transcript) {
+
+    // transcript ends with an entry whose cmd is NULL
+
+    _transcript = transcript;
+    _line_len = 0;
+    _rx = NULL;
+    _log_len = 0;
+    _log[0] = '\0';
+    _last = "";
+
+}
+
+uint32_t stub_modem_seen(const char *prefix) {
+
+    // how many commands started with prefix
+
+    const char *line = _log;
+    uint32_t n = 0;
+
+    while (*line) {
+        if (!strncmp(line, prefix, strlen(prefix))) n++;
+        line = strchr(line, '\n') + 1;
+    }
+
+    return n;
+
+}
+
+const char *stub_modem_last(void) {
+
+    return _last;
+
+}
+
+uint64_t millis(void) {
+
+    return _now;
+
+}
+
+void millis_delay(uint64_t duration_ms) {
+
+    _now += duration_ms;
+
+}
+
+uint32_t stub_usart_sr(uint32_t usart) {
+
+    (void) usart;
+
+    if (_rx && *_rx) return USART_SR_RXNE;
+
+    _now++;     // nothing on the line, time goes by while we wait
+
+    return 0;
+
+}
+
+uint16_t usart_recv(uint32_t usart) {
+
+    (void) usart;
+
+    return (_rx && *_rx) ? (uint8_t) *_rx++ : 0;
+
+}
+
+void usart_send_blocking(uint32_t usart, uint16_t data) {
+
+    (void) usart;
+
+    if (_line_len < sizeof(_line) - 1) _line[_line_len++] = data;
+
+    if ((_line_len >= 2) && !strncmp(_line + _line_len - 2, "\r\n", 2)) {
+        _line[_line_len - 2] = '\0';
+        _respond();
+        _line_len = 0;
+    }
+
+}
+
+void usart_set_baudrate(uint32_t usart, uint32_t baud) { (void) usart; (void) baud; }
+void usart_set_databits(uint32_t usart, uint32_t bits) { (void) usart; (void) bits; }
+void usart_set_parity(uint32_t usart, uint32_t parity) { (void) usart; (void) parity; }
+void usart_set_stopbits(uint32_t usart, uint32_t bits) { (void) usart; (void) bits; }
+void usart_set_mode(uint32_t usart, uint32_t mode) { (void) usart; (void) mode; }
+void usart_set_flow_control(uint32_t usart, uint32_t fc) { (void) usart; (void) fc; }
+void usart_enable(uint32_t usart) { (void) usart; }
+void usart_disable(uint32_t usart) { (void) usart; }
+
+static void _respond(void) {
+
+    const struct stub_at *at;
+    size_t n = strlen(_line);
+
+    if (_log_len + n + 2 <= sizeof(_log)) {
+        memcpy(_log + _log_len, _line, n);
+        _last = _log + _log_len;
+        _log_len += n;
+        _log[_log_len++] = '\n';
+        _log[_log_len] = '\0';
+    }
+
+    for (at = _transcript; at->cmd; at++) {
+        if (!strncmp(_line, at->cmd, strlen(at->cmd))) {
+            _now += at->ms;
+            _rx = at->response;
+            return;
+        }
+    }
+
+    _rx = "\r\nERROR\r\n";
+
+}
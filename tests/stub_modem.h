@@ -0,0 +1,20 @@
+#ifndef STUB_MODEM_H
+#define STUB_MODEM_H
+
+// A SIM7000 stand-in on the other end of USART2, for running modem.c on
+// the host. It answers each AT command with the first transcript entry
+// the command starts with, or ERROR if there's none. Time only passes
+// while the modem is thinking (ms) and while the line is idle, so
+// latencies come out the same on every run.
+
+struct stub_at {
+    const char *cmd;        // a command starting with this
+    const char *response;   // is answered with this, \r\n framing and all,
+    uint32_t ms;            // this long after it was sent
+};
+
+void stub_modem_setup(const struct stub_at*);
+uint32_t stub_modem_seen(const char*);
+const char *stub_modem_last(void);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef STUB_GPIO_H
+#define STUB_GPIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// just enough of libopencm3 to build modem.c on the host, see stub_hw.c
+
+#define GPIOA 0
+#define GPIOB 1
+#define GPIOC 2
+
+#define GPIO0 (1 << 0)
+#define GPIO1 (1 << 1)
+#define GPIO2 (1 << 2)
+#define GPIO3 (1 << 3)
+#define GPIO7 (1 << 7)
+#define GPIO8 (1 << 8)
+#define GPIO9 (1 << 9)
+#define GPIO10 (1 << 10)
+
+#define GPIO_MODE_INPUT 0
+#define GPIO_MODE_OUTPUT 1
+#define GPIO_MODE_AF 2
+#define GPIO_PUPD_NONE 0
+#define GPIO_AF7 7
+
+void gpio_mode_setup(uint32_t, uint8_t, uint8_t, uint16_t);
+void gpio_set_af(uint32_t, uint8_t, uint16_t);
+void gpio_set(uint32_t, uint16_t);
+void gpio_clear(uint32_t, uint16_t);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef STUB_RCC_H
+#define STUB_RCC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// just enough of libopencm3 to build modem.c on the host, see stub_hw.c
+
+enum {
+    RCC_GPIOA,
+    RCC_GPIOB,
+    RCC_GPIOC,
+    RCC_USART2,
+};
+
+extern uint32_t rcc_apb1_frequency;
+
+void rcc_periph_clock_enable(int);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef STUB_USART_H
+#define STUB_USART_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// just enough of libopencm3 to build modem.c on the host; USART2 is wired
+// to the modem stand-in, see stub_modem.c
+
+#define USART2 2
+
+#define USART_SR(usart) stub_usart_sr(usart)
+#define USART_SR_FE (1 << 1)
+#define USART_SR_NE (1 << 2)
+#define USART_SR_ORE (1 << 3)
+#define USART_SR_RXNE (1 << 5)
+
+#define USART_PARITY_NONE 0
+#define USART_CR2_STOPBITS_1 0
+#define USART_MODE_TX_RX 3
+#define USART_FLOWCONTROL_NONE 0
+#define USART_FLOWCONTROL_RTS_CTS 3
+
+uint32_t stub_usart_sr(uint32_t);
+void usart_set_baudrate(uint32_t, uint32_t);
+void usart_set_databits(uint32_t, uint32_t);
+void usart_set_parity(uint32_t, uint32_t);
+void usart_set_stopbits(uint32_t, uint32_t);
+void usart_set_mode(uint32_t, uint32_t);
+void usart_set_flow_control(uint32_t, uint32_t);
+void usart_enable(uint32_t);
+void usart_disable(uint32_t);
+void usart_send_blocking(uint32_t, uint16_t);
+uint16_t usart_recv(uint32_t);
+
+#endif
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "atparse.h"
+
+static int _failures = 0;
+
+static void _check(bool cond, const char *what) {
+
+    if (!cond) {
+        printf("FAIL: %s\n", what);
+        _failures++;
+    }
+
+}
+
+static void _test_shreq(void) {
+
+    uint32_t status = 0, len = 0;
+
+    _check(atparse_shreq("+SHREQ: \"POST\",200,0", "POST", &status, &len)
+           && (status == 200) && (len == 0), "POST 200, empty body");
+    _check(atparse_shreq("+SHREQ: \"GET\",200,387", "GET", &status, &len)
+           && (status == 200) && (len == 387), "GET 200 with a body");
+    _check(atparse_shreq("+SHREQ: \"POST\",401,12", "POST", &status, &len)
+           && (status == 401) && (len == 12), "POST that was refused");
+    _check(!atparse_shreq("+SHREQ: \"GET\",200,5", "POST", &status, &len), "wrong method");
+    _check(!atparse_shreq("+SHREQ: \"POS\",200,5", "POST", &status, &len), "truncated method");
+    _check(!atparse_shreq("+SHREQ: \"POST\",200", "POST", &status, &len), "no length");
+    _check(!atparse_shreq("+SHREQ: \"POST\",,5", "POST", &status, &len), "no status");
+    _check(!atparse_shreq("+HTTPACTION: 1,200,0", "POST", &status, &len), "another response");
+    _check(!atparse_shreq("", "GET", &status, &len), "empty line");
+
+}
+
+int main(void) {
+
+    _test_shreq();
+
+    printf("%s\n", _failures ? "FAILED" : "ok");
+
+    return _failures ? 1 : 0;
+
+}
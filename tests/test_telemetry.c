@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "config.h"
+#include "samples.h"
+#include "metrics.h"
+#include "modem.h"
+#include "telemetry.h"
+#include "stub_modem.h"
+
+// telemetry_post() over HTTPS, through modem.c and a modem stand-in, with
+// a new TLS connection per post and with one kept alive
+
+#define POSTS 8
+#define OK "\r\nOK\r\n"
+
+// the modem's side of AT+SH*; the handshake (AT+SHCONN) is what's slow
+static const struct stub_at _https[] = {
+    {"AT+CNACT?", "\r\n+CNACT: 0,\"0.0.0.0\"\r\n" OK, 20},
+    {"AT+CNACT=1,", OK "\r\n+APP PDP: ACTIVE\r\n", 1500},
+    {"AT+SHCONF=", OK, 20},
+    {"AT+CSSLCFG=", OK, 20},
+    {"AT+SHSSL=", OK, 20},
+    {"AT+SHCONN", OK, 3000},
+    {"AT+SHCHEAD", OK, 20},
+    {"AT+SHAHEAD=", OK, 20},
+    {"AT+SHBOD=", OK, 50},
+    {"AT+SHREQ=", OK "\r\n+SHREQ: \"POST\",200,0\r\n", 400},
+    {"AT+SHDISC", OK, 100},
+    {NULL, NULL, 0},
+};
+
+// an open connection the server turns the post down on
+static const struct stub_at _https_refused[] = {
+    {"AT+SHBOD=", OK, 50},
+    {"AT+SHREQ=", OK "\r\n+SHREQ: \"POST\",401,12\r\n", 400},
+    {"AT+SHDISC", OK, 100},
+    {NULL, NULL, 0},
+};
+
+static struct samples_queue _q;
+static int _failures = 0;
+
+static void _check(bool cond, const char *what) {
+
+    if (!cond) {
+        printf("FAIL: %s\n", what);
+        _failures++;
+    }
+
+}
+
+static void _push(void) {
+
+    struct sample s = {0};
+
+    s.values[0] = 21.5f;
+    s.channels = 1;
+    samples_push(&s);
+
+}
+
+static uint32_t _run(uint32_t tls, const char *name, uint32_t handshakes) {
+
+    // POSTS posts, one sample each; returns the mean latency in ms
+
+    uint32_t h = metrics_get(METRIC_TLS_HANDSHAKES);
+    uint32_t ms = metrics_get(METRIC_UPLOAD_LATENCY_TOTAL_MS);
+    size_t n;
+
+    config_get()->tls = tls;
+    stub_modem_setup(_https);
+
+    _check(telemetry_connect(), "app network up");
+    for (int i=0; i<POSTS; i++) {
+        _push();
+        n = telemetry_post();
+        _check(n == 1, "post went through");
+        samples_drop(n);
+    }
+
+    h = metrics_get(METRIC_TLS_HANDSHAKES) - h;
+    ms = (metrics_get(METRIC_UPLOAD_LATENCY_TOTAL_MS) - ms) / POSTS;
+    printf("%-10s %u posts, %u handshakes, %u ms per post\n",
+            name, POSTS, (unsigned) h, (unsigned) ms);
+
+    _check(h == handshakes, "handshakes");
+    _check(stub_modem_seen("AT+SHREQ=\"/api/v1/" CONFIG_TOKEN "/telemetry\",3") == POSTS,
+           "every post to the telemetry path");
+
+    return ms;
+
+}
+
+static void _test_health(void) {
+
+    // RAM use goes to the telemetry endpoint like samples do
+
+    stub_modem_setup(_https);
+
+    _check(telemetry_post_health(), "health posted");
+    _check(stub_modem_seen("AT+SHBOD=\"{\\\"mem_heap\\\":1024,\\\"mem_heap_max\\\":1536,"
+                           "\\\"mem_stack_max\\\":2048,\\\"mem_free\\\":20736}\"") == 1,
+           "health keys");
+    _check(stub_modem_seen("AT+SHREQ=\"/api/v1/" CONFIG_TOKEN "/telemetry\",3") == 1,
+           "health to the telemetry path");
+
+}
+
+static void _test_refused(void) {
+
+    // a post that isn't a 200 fails, and drops the connection
+
+    stub_modem_setup(_https_refused);
+
+    _push();
+    _check(modem_https_connected(), "still connected from before");
+    _check(telemetry_post() == 0, "refused post fails");
+    _check(samples_count() == 1, "refused sample kept");
+    _check(!modem_https_connected(), "connection dropped");
+    _check(stub_modem_seen("AT+SHDISC") == 1, "disconnected");
+    samples_drop(1);
+
+}
+
+int main(void) {
+
+    uint32_t per_post, kept;
+
+    config_load();
+    samples_setup(&_q);
+
+    per_post = _run(CONFIG_TLS_PER_POST, "per post", POSTS);
+    kept = _run(CONFIG_TLS_KEEP_ALIVE, "keep-alive", 1);
+    _check(kept < per_post, "keep-alive is quicker per post");
+
+    _test_health();
+    _test_refused();
+
+    printf("%s\n", _failures ? "FAILED" : "ok");
+
+    return _failures ? 1 : 0;
+
+}
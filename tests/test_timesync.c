@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "samples.h"
+#include "timesync.h"
+#include "millis.h"
+#include "stub_modem.h"
+
+// timesync.c through modem.c, against a modem whose clock (AT+CCLK?) keeps
+// true UTC while millis() runs DRIFT_PPM slow of it
+
+#define EPOCH_S 1704067200      // 2024-01-01 00:00:00 UTC
+#define DRIFT_PPM 2000
+#define OK "\r\nOK\r\n"
+
+static char _cclk[64];
+static int64_t _offset_ms = 0;  // the modem clock's error
+static uint64_t _lost_ms = 0;   // how far warm_clock() has fallen behind
+
+static struct stub_at _modem[] = {
+    {"AT+CCLK?", _cclk, 0},
+    {"AT+CNTPCID=", OK, 20},
+    {"AT+CNTP=", OK, 20},
+    {"AT+CNTP", OK "\r\n+CNTP: 1\r\n", 500},
+    {NULL, NULL, 0},
+};
+
+static struct timesync _t;
+static struct samples_queue _q;
+static int _failures = 0;
+
+uint64_t warm_clock(void) {
+
+    return millis() - _lost_ms;
+
+}
+
+static void _check(bool cond, const char *what) {
+
+    if (!cond) {
+        printf("FAIL: %s\n", what);
+        _failures++;
+    }
+
+}
+
+static uint64_t _true_utc(uint64_t local) {
+
+    return (uint64_t) EPOCH_S * 1000 + local + local * DRIFT_PPM / 1000000;
+
+}
+
+static bool _sync(void) {
+
+    // the modem's clock now, to the second as CCLK has it, in January 2024
+
+    uint64_t s = (_true_utc(millis()) + _offset_ms) / 1000 - EPOCH_S;
+
+    snprintf(_cclk, sizeof(_cclk), "\r\n+CCLK: \"24/01/%02u,%02u:%02u:%02u+00\"\r\n" OK,
+            (unsigned) (1 + s / 86400), (unsigned) (s / 3600 % 24),
+            (unsigned) (s / 60 % 60), (unsigned) (s % 60));
+    stub_modem_setup(_modem);
+
+    return timesync_sync();
+
+}
+
+static int64_t _error(uint64_t local) {
+
+    // against the modem's clock
+
+    return (int64_t) (timesync_utc(local) - _true_utc(local + _lost_ms)) - _offset_ms;
+
+}
+
+static bool _near(int64_t error, int64_t ms) {
+
+    return (error <= ms) && (error >= -ms);
+
+}
+
+static void _test_unset(void) {
+
+    // a clock the network hasn't set falls back to NTP, and isn't taken
+
+    strcpy(_cclk, "\r\n+CCLK: \"80/01/06,00:00:12+00\"\r\n" OK);
+    stub_modem_setup(_modem);
+
+    _check(!timesync_sync(), "unset clock not taken");
+    _check(stub_modem_seen("AT+CNTP=\"" TIMESYNC_NTP_SERVER "\"") == 1, "NTP tried");
+    _check(!timesync_valid() && !timesync_utc(warm_clock()), "still not synced");
+
+}
+
+static void _test_stamp_before_sync(void) {
+
+    // a sample taken before the first sync gets its UTC time when it's sent
+
+    struct sample s = {0};
+    char buf[SAMPLES_PAYLOAD_SIZE];
+    unsigned long long ts;
+    uint64_t taken;
+
+    millis_delay(60000);
+    taken = s.ts = warm_clock();
+    s.values[0] = 21.5f;
+    s.channels = 1;
+    samples_push(&s);
+
+    samples_format_json(buf, sizeof(buf), 1);
+    _check(!strstr(buf, "\"ts\""), "no UTC time before a sync");
+
+    millis_delay(600000);
+    _check(_sync(), "first sync");
+
+    samples_format_json(buf, sizeof(buf), 1);
+    _check(sscanf(buf, "[{\"ts\":%llu", &ts) == 1, "UTC time once synced");
+    printf("stamped %lld ms out, 10 min before the first sync\n",
+            (long long) (ts - _true_utc(taken)));
+    _check(_near(ts - _true_utc(taken), 1000 + 600000LL * DRIFT_PPM / 1000000),
+            "stamp before the sync");
+    samples_drop(1);
+
+}
+
+static void _test_drift(void) {
+
+    // hourly syncs measure the drift, after which the time holds between them
+
+    for (int i=0; i<4; i++) {
+        millis_delay(TIMESYNC_INTERVAL_MS);
+        _check(_sync(), "hourly sync");
+    }
+
+    printf("drift %ld ppm, %ld ms out an hour on\n", (long) timesync_drift_ppm(),
+            (long) _error(warm_clock() + TIMESYNC_INTERVAL_MS));
+    _check(_near(timesync_drift_ppm() - DRIFT_PPM, 300), "drift measured");
+    _check(_near(_error(warm_clock() + TIMESYNC_INTERVAL_MS), 2000), "holds between syncs");
+
+}
+
+static void _test_slew(void) {
+
+    // the time a warm restart takes is lost to warm_clock(); the next sync
+    // finds it and works it in gradually, keeping stamps in order
+
+    uint64_t local, prev;
+    int32_t slew;
+
+    _lost_ms = 20000;
+    timesync_setup(&_t, true);
+    millis_delay(TIMESYNC_INTERVAL_MS);
+    local = warm_clock();
+    _check(_sync(), "sync after a warm restart");
+
+    slew = timesync_slew_ms();
+    printf("slewing %ld ms over %lu s\n", (long) slew,
+            (unsigned long) (slew * 1000LL / TIMESYNC_SLEW_PPM));
+    _check(_near(slew - _lost_ms, 2000), "error to slew");
+    _check(_near(timesync_utc(local) - timesync_utc(local - 1) - 1, 1), "no step at the sync");
+
+    prev = timesync_utc(local);
+    for (uint64_t t=local+1000; t<local + 2 * TIMESYNC_INTERVAL_MS; t+=1000) {
+        _check(timesync_utc(t) > prev, "in order while slewing");
+        prev = timesync_utc(t);
+    }
+
+    millis_delay(slew * 1000000LL / TIMESYNC_SLEW_PPM + 1000);
+    _check(timesync_slew_ms() == 0, "slewed");
+    _check(_near(_error(warm_clock()), 2000), "corrected");
+    _check(_near(timesync_drift_ppm() - DRIFT_PPM, 300), "drift kept");
+
+}
+
+static void _test_step(void) {
+
+    // an error too big to slew out is stepped
+
+    _offset_ms = 10 * TIMESYNC_STEP_MS;
+    millis_delay(TIMESYNC_INTERVAL_MS);
+    _check(_sync(), "sync with a big error");
+
+    _check(timesync_slew_ms() == 0, "not slewed");
+    _check(_near(_error(warm_clock()), 1000), "stepped");
+
+}
+
+int main(void) {
+
+    samples_setup(&_q);
+    samples_set_clock(timesync_utc);
+    timesync_setup(&_t, false);
+
+    _test_unset();
+    _test_stamp_before_sync();
+    _test_drift();
+    _test_slew();
+    _test_step();
+
+    printf("%s\n", _failures ? "FAILED" : "ok");
+
+    return _failures ? 1 : 0;
+
+}
@@ -0,0 +1,848 @@
+// fleet load generator: runs thousands of virtual devices against an ingest
+// server from one process, to see what happens when a whole cell's worth of
+// devices comes back after an outage. See README.md in this directory
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "config.h"
+#include "samples.h"
+#include "metrics.h"
+#include "radio.h"
+#include "uplink.h"
+
+#define LOADGEN_MAX_EVENTS 256
+#define LOADGEN_TX_SIZE (SAMPLES_PAYLOAD_SIZE + 256)
+#define LOADGEN_RX_SIZE 512
+#define LOADGEN_STUB_RX_SIZE 2048
+#define LOADGEN_BUCKETS 40      // rows in the storm histogram
+
+//
+
+enum kind {
+    KIND_DEVICE,
+    KIND_LISTEN,
+    KIND_STUB,
+};
+
+enum state {
+    DEV_OUTAGE,         // waiting for the network to come back
+    DEV_IDLE,
+    DEV_BEARER,         // bringing the bearer up, see -c
+    DEV_CONNECTING,
+    DEV_SENDING,
+    DEV_RECEIVING,
+};
+
+struct device {
+    enum kind kind;     // first, see _on_event()
+    enum state state;
+    uint32_t id;
+    uint32_t gen;       // bumped to invalidate pending wakeups
+    int fd;
+    bool drained;
+    size_t batch;       // samples in the request in flight
+    size_t len;         // and its payload's length
+    float value;        // the sensor reading, wanders a little every sample
+    uint64_t registered;
+    uint64_t next_sample;
+    uint64_t deadline;
+    uint64_t started_us;
+    struct uplink up;   // the firmware's upload schedule, see uplink.c
+    struct radio_history radio;
+    struct samples_queue q;
+    char tx[LOADGEN_TX_SIZE];
+    size_t tx_len, tx_off;
+    char rx[LOADGEN_RX_SIZE];
+    size_t rx_len;
+};
+
+struct stub_conn {
+    enum kind kind;
+    int fd;
+    char rx[LOADGEN_STUB_RX_SIZE];
+    size_t rx_len;
+};
+
+struct wakeup {
+    uint64_t t;
+    uint32_t dev;
+    uint32_t gen;
+};
+
+struct bucket {
+    uint32_t started;
+    uint32_t ok;
+    uint32_t failed;
+};
+
+static struct {
+    uint32_t devices;
+    const char *host;
+    uint16_t port;
+    uint32_t duration_ms;
+    uint32_t spread_ms;
+    uint32_t backlog;
+    uint32_t timeout_ms;
+    uint32_t bearer_ms;
+    uint32_t good_pct;
+    bool keep_alive;
+    bool stub;
+} _opt = {
+    .devices = 1000,
+    .host = "127.0.0.1",
+    .port = 8080,
+    .duration_ms = 60000,
+    .spread_ms = 0,
+    .backlog = SAMPLES_MAX,
+    .timeout_ms = 10000,
+    .bearer_ms = 2000,
+    .good_pct = 100,
+    .keep_alive = false,
+    .stub = false,
+};
+
+// every device's settings, the firmware's defaults unless told otherwise
+static struct config _config = {
+    .sample_interval_ms = CONFIG_SAMPLE_INTERVAL_MS,
+    .upload_interval_ms = CONFIG_UPLOAD_INTERVAL_MS,
+    .batch_size = CONFIG_BATCH_SIZE,
+    .report_threshold = CONFIG_REPORT_THRESHOLD,
+    .upload_min_rssi = CONFIG_UPLOAD_MIN_RSSI,
+    .upload_max_ber = CONFIG_UPLOAD_MAX_BER,
+    .upload_max_delay_ms = CONFIG_UPLOAD_MAX_DELAY_MS,
+};
+
+static struct {
+    uint64_t ok;
+    uint64_t failed;
+    uint64_t timeouts;
+    uint64_t connects;
+    uint64_t bearers;
+    uint64_t samples;
+    uint64_t stub_requests;
+    uint32_t *latency_us;
+    size_t latency_n, latency_size;
+    uint32_t *recovery_ms;
+    size_t recovery_n;
+    struct bucket buckets[LOADGEN_BUCKETS];
+    uint32_t bucket_ms;
+} _stats;
+
+static struct device *_devs;
+static struct wakeup *_heap;
+static size_t _heap_n, _heap_size;
+static struct sockaddr_in _addr;
+static int _epfd;
+static uint64_t _t0;
+
+static void _device_tick(struct device*, uint64_t);
+
+////
+
+static uint64_t _now_us(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+}
+
+static uint64_t _now(void) {
+
+    // ms since the start of the run, the device's millis()
+
+    return _now_us() / 1000 - _t0;
+
+}
+
+static uint64_t _utc_ms(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+}
+
+static void _die(const char *what) {
+
+    perror(what);
+    exit(1);
+
+}
+
+//// wakeups, a binary min-heap; stale entries are skipped by generation
+
+static void _schedule(struct device *d, uint64_t t) {
+
+    size_t i, parent;
+    struct wakeup w;
+
+    if (_heap_n == _heap_size) {
+        _heap_size = _heap_size ? 2 * _heap_size : 1024;
+        _heap = realloc(_heap, _heap_size * sizeof(*_heap));
+        if (!_heap) _die("realloc");
+    }
+
+    w.t = t;
+    w.dev = d->id;
+    w.gen = ++d->gen;
+
+    for (i=_heap_n++; i; i=parent) {
+        parent = (i - 1) / 2;
+        if (_heap[parent].t <= t) break;
+        _heap[i] = _heap[parent];
+    }
+    _heap[i] = w;
+
+}
+
+static void _heap_pop(void) {
+
+    struct wakeup last = _heap[--_heap_n];
+    size_t i = 0, child;
+
+    while ((child = 2 * i + 1) < _heap_n) {
+        if ((child + 1 < _heap_n) && (_heap[child + 1].t < _heap[child].t)) child++;
+        if (last.t <= _heap[child].t) break;
+        _heap[i] = _heap[child];
+        i = child;
+    }
+    _heap[i] = last;
+
+}
+
+//// stats
+
+static struct bucket *_bucket(uint64_t now) {
+
+    size_t i = now / _stats.bucket_ms;
+
+    return &_stats.buckets[(i < LOADGEN_BUCKETS) ? i : LOADGEN_BUCKETS - 1];
+
+}
+
+static void _record_latency(uint32_t us) {
+
+    if (_stats.latency_n == _stats.latency_size) {
+        _stats.latency_size = _stats.latency_size ? 2 * _stats.latency_size : 4096;
+        _stats.latency_us = realloc(_stats.latency_us,
+                _stats.latency_size * sizeof(*_stats.latency_us));
+        if (!_stats.latency_us) _die("realloc");
+    }
+
+    _stats.latency_us[_stats.latency_n++] = us;
+
+}
+
+static int _cmp_u32(const void *a, const void *b) {
+
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+
+}
+
+static uint32_t _percentile(const uint32_t *sorted, size_t n, unsigned p) {
+
+    if (!n) return 0;
+
+    return sorted[(n - 1) * p / 100];
+
+}
+
+//// device side, main.c's loop with the scheduling done by uplink.c
+
+static void _device_close(struct device *d, bool reset) {
+
+    // with thousands of short connections a second the client side would
+    // run out of ports to TIME_WAIT, so failed (or per-post) connections
+    // are reset rather than closed
+
+    struct linger lin = {1, 0};
+
+    if (d->fd < 0) return;
+
+    if (reset) setsockopt(d->fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+    close(d->fd);
+    d->fd = -1;
+
+}
+
+static void _device_watch(struct device *d, uint32_t events) {
+
+    struct epoll_event ev;
+
+    ev.events = events;
+    ev.data.ptr = d;
+    if (epoll_ctl(_epfd, EPOLL_CTL_MOD, d->fd, &ev)) _die("epoll_ctl");
+
+}
+
+static void _device_use(struct device *d) {
+
+    // point the firmware's modules at this device's state
+
+    samples_setup(&d->q);
+    radio_setup(&d->radio);
+
+}
+
+static void _device_wait(struct device *d) {
+
+    d->state = DEV_IDLE;
+    _schedule(d, uplink_wake(&d->up, d->next_sample));
+
+}
+
+static void _device_done(struct device *d, bool ok, uint64_t now) {
+
+    uint32_t latency_us = _now_us() - d->started_us;
+
+    _device_use(d);
+    radio_account(d->len, latency_us / 1000, ok);
+    uplink_posted(&d->up, &_config, now, ok ? d->batch : 0);
+
+    if (ok) {
+        _stats.ok++;
+        _stats.samples += d->batch;
+        _bucket(now)->ok++;
+        _record_latency(latency_us);
+        if (!d->drained && (samples_count() < _config.batch_size)) {
+            _stats.recovery_ms[_stats.recovery_n++] = now - d->registered;
+            d->drained = true;
+        }
+    } else {
+        _stats.failed++;
+        _bucket(now)->failed++;
+    }
+
+    if (!ok || !_opt.keep_alive) _device_close(d, true);
+    if (d->fd >= 0) _device_watch(d, EPOLLIN | EPOLLRDHUP);
+
+    _device_wait(d);
+
+}
+
+static void _device_send(struct device *d) {
+
+    ssize_t r;
+
+    while (d->tx_off < d->tx_len) {
+        r = send(d->fd, d->tx + d->tx_off, d->tx_len - d->tx_off, MSG_NOSIGNAL);
+        if (r < 0) {
+            if (errno == EAGAIN) return;
+            _device_done(d, false, _now());
+            return;
+        }
+        d->tx_off += r;
+    }
+
+    d->state = DEV_RECEIVING;
+    d->rx_len = 0;
+    _device_watch(d, EPOLLIN);
+
+}
+
+static void _device_receive(struct device *d) {
+
+    // wait for a whole response, the body (if any) included
+
+    const char *end, *cl;
+    size_t body;
+    ssize_t r;
+
+    r = recv(d->fd, d->rx + d->rx_len, sizeof(d->rx) - 1 - d->rx_len, 0);
+    if (r < 0) {
+        if (errno == EAGAIN) return;
+        _device_done(d, false, _now());
+        return;
+    }
+    if ((r == 0) || (d->rx_len + r >= sizeof(d->rx) - 1)) {
+        _device_done(d, false, _now());
+        return;
+    }
+    d->rx_len += r;
+    d->rx[d->rx_len] = '\0';
+
+    end = strstr(d->rx, "\r\n\r\n");
+    if (!end) return;
+
+    cl = strcasestr(d->rx, "Content-Length:");
+    body = cl ? strtoul(cl + 15, NULL, 10) : 0;
+    if ((size_t) (d->rx + d->rx_len - (end + 4)) < body) return;
+
+    _device_done(d, !strncmp(d->rx, "HTTP/1.1 200", 12), _now());
+
+}
+
+static void _device_request(struct device *d, uint64_t now) {
+
+    // the same payload the firmware would post, see _upload() in main.c
+
+    struct epoll_event ev;
+    char payload[SAMPLES_PAYLOAD_SIZE];
+    char path[CONFIG_URL_SIZE];
+
+    samples_setup(&d->q);
+    d->batch = samples_format_json(payload, sizeof(payload), SAMPLES_MAX_BATCH);
+    d->len = strlen(payload);
+
+    // config_telemetry_path(), with a token per device
+    snprintf(path, sizeof(path), "/api/v1/dev%06u/telemetry", (unsigned) d->id);
+
+    d->tx_len = snprintf(d->tx, sizeof(d->tx),
+            "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Type: application/json\r\n"
+            "Content-Length: %u\r\n%s\r\n%s", path, _opt.host, (unsigned) d->len,
+            _opt.keep_alive ? "" : "Connection: close\r\n", payload);
+    d->tx_off = 0;
+    d->started_us = _now_us();
+    d->deadline = now + _opt.timeout_ms;
+    _bucket(now)->started++;
+
+    if (d->fd >= 0) {
+        d->state = DEV_SENDING;
+        _device_watch(d, EPOLLOUT);
+        _device_send(d);
+        if (d->fd >= 0) _schedule(d, d->deadline);
+        return;
+    }
+
+    d->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (d->fd < 0) {
+        _device_done(d, false, now);
+        return;
+    }
+    _stats.connects++;
+
+    ev.events = EPOLLOUT;
+    ev.data.ptr = d;
+    if (epoll_ctl(_epfd, EPOLL_CTL_ADD, d->fd, &ev)) _die("epoll_ctl");
+
+    if (connect(d->fd, (struct sockaddr *) &_addr, sizeof(_addr)) && (errno != EINPROGRESS)) {
+        _device_done(d, false, now);
+        return;
+    }
+
+    d->state = DEV_CONNECTING;
+    _schedule(d, d->deadline);
+
+}
+
+static void _device_tick(struct device *d, uint64_t now) {
+
+    struct sample sample = {0};
+    bool good;
+
+    if (d->state == DEV_OUTAGE) {
+        // back on the network, with the bearer gone: main.c starts out
+        // with a sample and an upload due
+        d->state = DEV_IDLE;
+        d->registered = now;
+        d->next_sample = now;
+        uplink_setup(&d->up, false);
+    }
+
+    _device_use(d);
+
+    if (now >= d->next_sample) {
+        d->next_sample = now + _config.sample_interval_ms;
+        d->value += (rand() % 21 - 10) / 100.0f;
+        sample.ts = _utc_ms();
+        sample.values[0] = d->value;
+        sample.channels = 1;
+        samples_push(&sample);
+        uplink_sampled(&d->up, &_config, &sample);
+
+        // the vitals poll, a signal that's good good_pct of the time
+        good = (uint32_t) (rand() % 100) < _opt.good_pct;
+        radio_record(good ? 20 : 5, good ? 0 : RADIO_UNKNOWN);
+    }
+
+    if (!uplink_ready(&d->up, &_config, now,
+                radio_link_good(_config.upload_min_rssi, _config.upload_max_ber))) {
+        _device_wait(d);
+        return;
+    }
+
+    // a failed post took the bearer down with it
+    if (!d->up.connected) {
+        d->state = DEV_BEARER;
+        _stats.bearers++;
+        _schedule(d, now + _opt.bearer_ms);
+        return;
+    }
+
+    _device_request(d, now);
+
+}
+
+static void _device_event(struct device *d, uint32_t events) {
+
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    switch (d->state) {
+
+        case DEV_CONNECTING:
+            if (events & (EPOLLERR | EPOLLHUP)) {
+                _device_done(d, false, _now());
+                return;
+            }
+            if (!(events & EPOLLOUT)) return;
+            getsockopt(d->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err) {
+                _device_done(d, false, _now());
+                return;
+            }
+            d->state = DEV_SENDING;
+            _device_send(d);
+            return;
+
+        case DEV_SENDING:
+            _device_send(d);
+            return;
+
+        case DEV_RECEIVING:
+            if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) _device_receive(d);
+            return;
+
+        default:
+            // a kept-alive connection the server has given up on
+            if (events & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP)) _device_close(d, false);
+            return;
+
+    }
+
+}
+
+static void _device_wakeup(struct device *d, uint64_t now) {
+
+    switch (d->state) {
+
+        case DEV_OUTAGE:
+        case DEV_IDLE:
+            _device_tick(d, now);
+            return;
+
+        case DEV_BEARER:
+            d->up.connected = true;
+            _device_request(d, now);
+            return;
+
+        default:
+            // a wakeup while a request is in flight is its deadline
+            _stats.timeouts++;
+            _device_done(d, false, now);
+            return;
+
+    }
+
+}
+
+//// ingest stub, answers every request with 200 OK
+
+static void _stub_accept(int lfd) {
+
+    struct stub_conn *c;
+    struct epoll_event ev;
+    int fd;
+
+    while ((fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+        c = calloc(1, sizeof(*c));
+        if (!c) _die("calloc");
+        c->kind = KIND_STUB;
+        c->fd = fd;
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev)) _die("epoll_ctl");
+    }
+
+}
+
+static void _stub_event(struct stub_conn *c) {
+
+    static const char response[] = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    const char *end, *cl;
+    size_t len, body;
+    ssize_t r;
+    bool close_after;
+
+    r = recv(c->fd, c->rx + c->rx_len, sizeof(c->rx) - 1 - c->rx_len, 0);
+    if ((r < 0) && (errno == EAGAIN)) return;
+    if ((r <= 0) || (c->rx_len + r >= sizeof(c->rx) - 1)) {
+        close(c->fd);
+        free(c);
+        return;
+    }
+    c->rx_len += r;
+    c->rx[c->rx_len] = '\0';
+
+    while ((end = strstr(c->rx, "\r\n\r\n"))) {
+
+        cl = strcasestr(c->rx, "Content-Length:");
+        body = (cl && (cl < end)) ? strtoul(cl + 15, NULL, 10) : 0;
+        len = end + 4 - c->rx + body;
+        if (len > c->rx_len) return;
+
+        close_after = strcasestr(c->rx, "Connection: close") != NULL;
+        _stats.stub_requests++;
+        if (send(c->fd, response, sizeof(response) - 1, MSG_NOSIGNAL) < 0) close_after = true;
+
+        memmove(c->rx, c->rx + len, c->rx_len - len + 1);
+        c->rx_len -= len;
+
+        // the client closes (or resets) its end, see _device_close()
+        if (close_after) return;
+
+    }
+
+}
+
+static int _stub_listen(void) {
+
+    struct epoll_event ev;
+    static enum kind listen_kind = KIND_LISTEN;
+    int fd, one = 1;
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) _die("socket");
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *) &_addr, sizeof(_addr))) _die("bind");
+    if (listen(fd, SOMAXCONN)) _die("listen");
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &listen_kind;
+    if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev)) _die("epoll_ctl");
+
+    return fd;
+
+}
+
+////
+
+static void _on_event(struct epoll_event *ev, int lfd) {
+
+    enum kind kind = *(enum kind *) ev->data.ptr;
+
+    switch (kind) {
+        case KIND_DEVICE: _device_event(ev->data.ptr, ev->events); break;
+        case KIND_LISTEN: _stub_accept(lfd); break;
+        case KIND_STUB: _stub_event(ev->data.ptr); break;
+    }
+
+}
+
+static void _report(uint64_t elapsed) {
+
+    uint32_t max = 1, p;
+    size_t i, bar;
+
+    printf("\n%u devices, %.1f s, %s, batch %u, backlog %u samples, spread %u ms\n",
+            (unsigned) _opt.devices, elapsed / 1000., _opt.keep_alive ? "keep-alive" : "connection per post",
+            (unsigned) _config.batch_size, (unsigned) _opt.backlog, (unsigned) _opt.spread_ms);
+
+    if (_opt.stub) {
+        printf("stub: %llu requests\n", (unsigned long long) _stats.stub_requests);
+    }
+    if (!_opt.devices) return;
+
+    printf("requests: %llu ok, %llu failed (%llu timeouts), %llu connects, %llu samples\n",
+            (unsigned long long) _stats.ok, (unsigned long long) _stats.failed,
+            (unsigned long long) _stats.timeouts, (unsigned long long) _stats.connects,
+            (unsigned long long) _stats.samples);
+    printf("rate: %.1f requests/s\n", _stats.ok * 1000. / (elapsed ? elapsed : 1));
+    printf("bearer bring-ups: %llu, uploads deferred for the signal: %lu\n",
+            (unsigned long long) _stats.bearers,
+            (unsigned long) metrics_get(METRIC_UPLOADS_DEFERRED));
+
+    qsort(_stats.latency_us, _stats.latency_n, sizeof(uint32_t), _cmp_u32);
+    printf("latency (ms): p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\n",
+            _percentile(_stats.latency_us, _stats.latency_n, 50) / 1000.,
+            _percentile(_stats.latency_us, _stats.latency_n, 90) / 1000.,
+            _percentile(_stats.latency_us, _stats.latency_n, 99) / 1000.,
+            _percentile(_stats.latency_us, _stats.latency_n, 100) / 1000.);
+
+    // the time from coming back on the network to having sent the backlog,
+    // METRIC_RECOVERY_MS on a real device
+    qsort(_stats.recovery_ms, _stats.recovery_n, sizeof(uint32_t), _cmp_u32);
+    printf("backlog drained: %u of %u devices, p50 %u ms, p99 %u ms, max %u ms\n",
+            (unsigned) _stats.recovery_n, (unsigned) _opt.devices,
+            _percentile(_stats.recovery_ms, _stats.recovery_n, 50),
+            _percentile(_stats.recovery_ms, _stats.recovery_n, 99),
+            _percentile(_stats.recovery_ms, _stats.recovery_n, 100));
+
+    // reconnect storm shape
+    for (i=0; i<LOADGEN_BUCKETS; i++) {
+        if (_stats.buckets[i].started > max) max = _stats.buckets[i].started;
+    }
+    printf("\n%8s %8s %8s %8s\n", "t (s)", "started", "ok", "failed");
+    for (i=0; (i < LOADGEN_BUCKETS) && (i * _stats.bucket_ms < elapsed); i++) {
+        p = _stats.buckets[i].started;
+        printf("%8.1f %8u %8u %8u ", i * _stats.bucket_ms / 1000., (unsigned) p,
+                (unsigned) _stats.buckets[i].ok, (unsigned) _stats.buckets[i].failed);
+        for (bar = 0; bar < (size_t) p * 40 / max; bar++) putchar('#');
+        putchar('\n');
+    }
+
+}
+
+static void _usage(const char *prog, int status) {
+
+    fprintf(status ? stderr : stdout,
+            "usage: %s [options]\n"
+            "  -n N    virtual devices (%u), 0 to only run the stub\n"
+            "  -H ip   ingest server address (%s)\n"
+            "  -p N    ingest server port (%u)\n"
+            "  -d N    run time, s (%u)\n"
+            "  -i N    sample interval, ms (%u)\n"
+            "  -u N    upload interval, ms (%u)\n"
+            "  -b N    batch size, samples (%u)\n"
+            "  -T N    report threshold, C, 0 for off (%g)\n"
+            "  -m N    longest an upload waits for a good signal, ms (%u)\n"
+            "  -g N    percentage of signal readings that are good (%u)\n"
+            "  -c N    time to bring the bearer up, ms (%u)\n"
+            "  -q N    samples queued during the outage (%u, at most %u)\n"
+            "  -r N    spread of the devices' return to the network, ms (%u)\n"
+            "  -t N    request timeout, ms (%u)\n"
+            "  -k      keep connections alive between posts\n"
+            "  -S      run the ingest stub in-process\n"
+            "  -h      this\n",
+            prog, (unsigned) _opt.devices, _opt.host, (unsigned) _opt.port,
+            (unsigned) (_opt.duration_ms / 1000), (unsigned) _config.sample_interval_ms,
+            (unsigned) _config.upload_interval_ms, (unsigned) _config.batch_size,
+            _config.report_threshold, (unsigned) _config.upload_max_delay_ms,
+            (unsigned) _opt.good_pct, (unsigned) _opt.bearer_ms,
+            (unsigned) _opt.backlog, SAMPLES_MAX, (unsigned) _opt.spread_ms,
+            (unsigned) _opt.timeout_ms);
+    exit(status);
+
+}
+
+int main(int argc, char **argv) {
+
+    struct epoll_event events[LOADGEN_MAX_EVENTS];
+    struct rlimit rl;
+    struct sample sample;
+    struct device *d;
+    struct wakeup w;
+    uint64_t now, end;
+    int c, n, i, lfd = -1, timeout;
+    uint32_t j;
+
+    while ((c = getopt(argc, argv, "n:H:p:d:i:u:b:T:m:g:c:q:r:t:kSh")) != -1) {
+        switch (c) {
+            case 'n': _opt.devices = strtoul(optarg, NULL, 0); break;
+            case 'H': _opt.host = optarg; break;
+            case 'p': _opt.port = strtoul(optarg, NULL, 0); break;
+            case 'd': _opt.duration_ms = strtoul(optarg, NULL, 0) * 1000; break;
+            case 'i': _config.sample_interval_ms = strtoul(optarg, NULL, 0); break;
+            case 'u': _config.upload_interval_ms = strtoul(optarg, NULL, 0); break;
+            case 'b': _config.batch_size = strtoul(optarg, NULL, 0); break;
+            case 'T': _config.report_threshold = strtof(optarg, NULL); break;
+            case 'm': _config.upload_max_delay_ms = strtoul(optarg, NULL, 0); break;
+            case 'g': _opt.good_pct = strtoul(optarg, NULL, 0); break;
+            case 'c': _opt.bearer_ms = strtoul(optarg, NULL, 0); break;
+            case 'q': _opt.backlog = strtoul(optarg, NULL, 0); break;
+            case 'r': _opt.spread_ms = strtoul(optarg, NULL, 0); break;
+            case 't': _opt.timeout_ms = strtoul(optarg, NULL, 0); break;
+            case 'k': _opt.keep_alive = true; break;
+            case 'S': _opt.stub = true; break;
+            case 'h': _usage(argv[0], 0); break;
+            default: _usage(argv[0], 2);
+        }
+    }
+    if ((optind != argc) || (_opt.backlog > SAMPLES_MAX) || !_opt.duration_ms
+            || (_opt.good_pct > 100)) _usage(argv[0], 2);
+
+    _addr.sin_family = AF_INET;
+    _addr.sin_port = htons(_opt.port);
+    if (inet_pton(AF_INET, _opt.host, &_addr.sin_addr) != 1) _usage(argv[0], 2);
+
+    // a socket per device, and as many again for the stub
+    if (!getrlimit(RLIMIT_NOFILE, &rl)) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+        if (rl.rlim_cur < 2 * (rlim_t) _opt.devices + 64) {
+            fprintf(stderr, "warning: only %lu file descriptors for %u devices\n",
+                    (unsigned long) rl.rlim_cur, (unsigned) _opt.devices);
+        }
+    }
+
+    _epfd = epoll_create1(0);
+    if (_epfd < 0) _die("epoll_create1");
+    if (_opt.stub) lfd = _stub_listen();
+
+    _t0 = _now_us() / 1000;
+    _stats.bucket_ms = (_opt.duration_ms + LOADGEN_BUCKETS - 1) / LOADGEN_BUCKETS;
+
+    // every device has been out of coverage long enough to fill its queue,
+    // and comes back somewhere in the spread
+    _devs = calloc(_opt.devices ? _opt.devices : 1, sizeof(*_devs));
+    _stats.recovery_ms = calloc(_opt.devices ? _opt.devices : 1, sizeof(uint32_t));
+    if (!_devs || !_stats.recovery_ms) _die("calloc");
+
+    srand(1);
+    for (j=0; j<_opt.devices; j++) {
+        d = &_devs[j];
+        d->kind = KIND_DEVICE;
+        d->state = DEV_OUTAGE;
+        d->id = j;
+        d->fd = -1;
+        d->value = 20.0f + (j % 100) / 10.0f;
+        samples_setup(&d->q);
+        for (uint32_t k=0; k<_opt.backlog; k++) {
+            sample.ts = _utc_ms() - (uint64_t) (_opt.backlog - k) * _config.sample_interval_ms;
+            sample.values[0] = d->value;
+            sample.channels = 1;
+            samples_push(&sample);
+        }
+        _schedule(d, _opt.spread_ms ? (uint64_t) rand() % _opt.spread_ms : 0);
+    }
+
+    end = _opt.duration_ms;
+
+    while ((now = _now()) < end) {
+
+        // due wakeups
+        while (_heap_n && (_heap[0].t <= now)) {
+            w = _heap[0];
+            _heap_pop();
+            d = &_devs[w.dev];
+            if (w.gen == d->gen) _device_wakeup(d, now);
+        }
+
+        timeout = _heap_n ? (int) (_heap[0].t - now) : 100;
+        if (timeout > (int) (end - now)) timeout = end - now;
+
+        n = epoll_wait(_epfd, events, LOADGEN_MAX_EVENTS, timeout);
+        if ((n < 0) && (errno != EINTR)) _die("epoll_wait");
+        for (i=0; i<n; i++) _on_event(&events[i], lfd);
+
+    }
+
+    _report(_now());
+
+    return 0;
+
+}